@@ -8,7 +8,7 @@
 /*
 * Current Configuration is:
 * -------------------------
-* Routing Protocol: AODV/DSR/OLSR
+* Routing Protocol: AODV/DSR/OLSR/Cluster
 * Mobility Model: Gauss Markov
 * Simulation Area: 2000x2000x150 m
 * Number of nodes: 10/15/20/25
@@ -22,14 +22,42 @@
 * Transmission Power: 27 dBm (500 mW)
 */
 
-#define VERSION 0.13
+#define VERSION 0.14
 
 //C++ Libraries
 #include <fstream>
 #include <iostream>
+#include <vector>
+#include <map>
+#include <set>
+#include <queue>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <iomanip>
+
+//POSIX Libraries
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <cerrno>
+#include <malloc.h>
+
+//SQLite (libsqlite3-dev, see ns3_dependencies.sh)
+#include <sqlite3.h>
 
 //NS3 Libraries
 #include "ns3/core-module.h"
+#include "ns3/realtime-simulator-impl.h"
 #include "ns3/network-module.h"
 #include "ns3/internet-module.h"
 #include "ns3/mobility-module.h"
@@ -39,7 +67,10 @@
 #include "ns3/dsr-module.h"
 #include "ns3/applications-module.h"
 #include "ns3/yans-wifi-helper.h"
+#include "ns3/wifi-module.h"
+#include "ns3/traffic-control-module.h"
 #include "ns3/flow-monitor-helper.h"
+#include "ns3/ipv4-flow-classifier.h"
 #include "ns3/position-allocator.h"
 #include "ns3/animation-interface.h"
 
@@ -48,6 +79,2789 @@ using namespace dsr;
 
 NS_LOG_COMPONENT_DEFINE("routingProtocolsFANET");
 
+//Allocation counter
+//The global operator new is replaced so every C++ allocation of the program (packets, buffers, events, ns-3 objects in the shared
+//libraries too) adds its size here. The heap in use cannot show this: a steady run frees about as much as it allocates.
+//The array and sized forms of libstdc++ forward to these; the nothrow form is replaced too so it pairs with the free below
+static uint64_t g_allocatedBytes = 0;
+
+void *operator new(size_t size)
+{
+	__sync_fetch_and_add(&g_allocatedBytes, size);
+	void *memory = malloc(size ? size : 1);
+	if(!memory)
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	__sync_fetch_and_add(&g_allocatedBytes, size);
+	return malloc(size ? size : 1);
+}
+
+void operator delete(void *memory) noexcept
+{
+	free(memory);
+}
+
+//Big endian helpers for the cluster and telemetry payloads
+static inline void WriteU32(uint8_t *buffer, uint32_t value)
+{
+	buffer[0] = (value >> 24) & 0xff;
+	buffer[1] = (value >> 16) & 0xff;
+	buffer[2] = (value >> 8) & 0xff;
+	buffer[3] = value & 0xff;
+}
+
+static inline uint32_t ReadU32(const uint8_t *buffer)
+{
+	return (uint32_t(buffer[0]) << 24) | (uint32_t(buffer[1]) << 16) | (uint32_t(buffer[2]) << 8) | uint32_t(buffer[3]);
+}
+
+static inline void WriteU64(uint8_t *buffer, uint64_t value)
+{
+	WriteU32(buffer, value >> 32);
+	WriteU32(buffer + 4, value & 0xffffffff);
+}
+
+static inline uint64_t ReadU64(const uint8_t *buffer)
+{
+	return (uint64_t(ReadU32(buffer)) << 32) | ReadU32(buffer + 4);
+}
+
+//-----------------------------------------------------------------------------
+//Cluster based hierarchical routing (protocol 5)
+//Every node broadcasts a HELLO beacon once per period with its head, its election weight and the nodes it hears (with their heads).
+//Each node elects and joins a head from the HELLOs it receives, members reach each other through their head and clusters reach each
+//other through gateway nodes that border another cluster. Heads flood an advertisement with their members and adjacent clusters over
+//the head/gateway backbone, and every node routes between clusters on the cluster graph those advertisements describe.
+#define CLUSTER_PORT 6543 //UDP port used by the cluster beacons and advertisements
+#define CLUSTER_NONE 0xffffffff //Head of a node that has not joined a cluster yet
+#define ROUTING_PORT_AODV 654 //UDP ports of the ns-3 routing protocols, used to tell their control traffic apart
+#define ROUTING_PORT_OLSR 698
+#define ROUTING_PORT_DSDV 269
+
+class ClusterManager;
+
+//Per node routing protocol. It only answers route queries from the next hop table its node rebuilds every period
+class ClusterRouting : public Ipv4RoutingProtocol
+{
+	public:
+		static TypeId GetTypeId();
+		ClusterRouting();
+		void SetManager(ClusterManager *manager, uint32_t nodeId);
+
+		Ptr<Ipv4Route> RouteOutput(Ptr<Packet> p, const Ipv4Header &header, Ptr<NetDevice> oif, Socket::SocketErrno &sockerr);
+		bool RouteInput(Ptr<const Packet> p, const Ipv4Header &header, Ptr<const NetDevice> idev, UnicastForwardCallback ucb, MulticastForwardCallback mcb, LocalDeliverCallback lcb, ErrorCallback ecb);
+		void NotifyInterfaceUp(uint32_t interface) {}
+		void NotifyInterfaceDown(uint32_t interface) {}
+		void NotifyAddAddress(uint32_t interface, Ipv4InterfaceAddress address) {}
+		void NotifyRemoveAddress(uint32_t interface, Ipv4InterfaceAddress address) {}
+		void SetIpv4(Ptr<Ipv4> ipv4);
+		void PrintRoutingTable(Ptr<OutputStreamWrapper> stream, Time::Unit unit = Time::S) const;
+
+	private:
+		Ptr<Ipv4Route> LookupRoute(Ipv4Address dst) const;
+
+		Ptr<Ipv4> m_ipv4;
+		ClusterManager *m_manager; //Holds the next hop table of every node
+		uint32_t m_nodeId;
+};
+
+//Routing helper so the cluster protocol can be added to an Ipv4ListRoutingHelper like AODV/OLSR/DSDV
+class ClusterRoutingHelper : public Ipv4RoutingHelper
+{
+	public:
+		ClusterRoutingHelper(ClusterManager *manager);
+		ClusterRoutingHelper *Copy() const;
+		Ptr<Ipv4RoutingProtocol> Create(Ptr<Node> node) const;
+
+	private:
+		ClusterManager *m_manager;
+};
+
+//Runs the beacons of every node. The tables are indexed by node, but a node's entries are only filled from the packets that node received
+//and its routes only come from its own entries, no node reads the state of another one
+class ClusterManager
+{
+	public:
+		ClusterManager();
+		void Install(NodeContainer nodes, Ipv4InterfaceContainer interfaces);
+		void Start(double period, uint32_t metric);
+		bool NextHop(uint32_t node, Ipv4Address dst, Ipv4Address &nextHop) const;
+		uint32_t GetHead(uint32_t node) const;
+		uint32_t GetNClusters() const;
+
+	private:
+		//What a node knows about a neighbour, from the neighbour's last HELLO
+		struct Neighbour
+		{
+			Time heard;
+			uint32_t head;
+			uint32_t weight;
+			std::map<uint32_t, uint32_t> links; //Nodes the neighbour hears -> their head as the neighbour knows it
+		};
+
+		//What a node knows about a cluster, from the head's last advertisement
+		struct Cluster
+		{
+			Time heard;
+			uint32_t seq;
+			std::vector<uint32_t> members;
+			std::vector<uint32_t> adjacent; //Heads of the clusters that border this one
+		};
+
+		void Update(uint32_t node);
+		void Elect(uint32_t node, const std::set<uint32_t> &symmetric);
+		void Describe(uint32_t head, std::vector<uint32_t> &members, std::vector<uint32_t> &adjacent) const;
+		void BuildRoutes(uint32_t node, const std::set<uint32_t> &symmetric);
+		int32_t TowardsCluster(uint32_t node, const std::set<uint32_t> &symmetric, uint32_t cluster) const;
+		void SendHello(uint32_t node);
+		void SendAdvert(uint32_t head);
+		void Forward(uint32_t node, Ptr<Packet> packet);
+		void ReceivePacket(Ptr<Socket> socket);
+		void ReceiveHello(uint32_t node, const uint8_t *data, uint32_t length);
+		void ReceiveAdvert(uint32_t node, Ptr<Packet> packet, const uint8_t *data, uint32_t length);
+		static bool Heavier(uint32_t weightA, uint32_t a, uint32_t weightB, uint32_t b);
+
+		std::vector<Ptr<Socket> > m_sockets; //One beacon socket per node
+		std::vector<Ipv4Address> m_addresses; //Node index -> address
+		std::map<Ipv4Address, uint32_t> m_index; //Address -> node index
+		std::vector<std::map<uint32_t, Neighbour> > m_neighbours; //Per node: neighbour table
+		std::vector<std::map<uint32_t, Cluster> > m_clusters; //Per node: head -> latest advertisement received
+		std::vector<std::set<uint32_t> > m_previous; //Symmetric neighbours of the previous period, used by the stability metric
+		std::vector<uint32_t> m_head; //Cluster head each node has joined, CLUSTER_NONE while undecided
+		std::vector<uint32_t> m_weight; //Election weight of each node
+		std::vector<bool> m_gateway; //Node has a neighbour in another cluster
+		std::vector<uint32_t> m_seq; //Advertisement sequence of each head
+		std::vector<std::vector<int32_t> > m_nextHop; //[node][destination] -> next hop node index, -1 if unreachable
+		std::vector<uint8_t> m_advertBuffer; //Reused to build the advertisements
+		std::vector<uint8_t> m_receiveBuffer; //Reused to read the received beacons
+		Ptr<UniformRandomVariable> m_jitter;
+		Time m_period;
+		uint32_t m_metric; //1=Connectivity;2=Stability
+};
+
+TypeId ClusterRouting::GetTypeId()
+{
+	static TypeId tid = TypeId("ns3::ClusterRouting")
+		.SetParent<Ipv4RoutingProtocol>()
+		.SetGroupName("Internet")
+		.AddConstructor<ClusterRouting>();
+	return tid;
+}
+
+ClusterRouting::ClusterRouting()
+{
+	m_manager = 0;
+	m_nodeId = 0;
+}
+
+void ClusterRouting::SetManager(ClusterManager *manager, uint32_t nodeId)
+{
+	m_manager = manager;
+	m_nodeId = nodeId;
+}
+
+void ClusterRouting::SetIpv4(Ptr<Ipv4> ipv4)
+{
+	m_ipv4 = ipv4;
+}
+
+Ptr<Ipv4Route> ClusterRouting::LookupRoute(Ipv4Address dst) const
+{
+	Ipv4Address nextHop;
+	if(m_ipv4->GetNInterfaces() < 2 || !m_manager->NextHop(m_nodeId, dst, nextHop))
+	{
+		return 0;
+	}
+
+	Ptr<Ipv4Route> route = Create<Ipv4Route>();
+	route->SetDestination(dst);
+	route->SetGateway(nextHop);
+	route->SetSource(m_ipv4->GetAddress(1, 0).GetLocal()); //Interface 0 is the loopback, 1 is the ad-hoc device
+	route->SetOutputDevice(m_ipv4->GetNetDevice(1));
+	return route;
+}
+
+Ptr<Ipv4Route> ClusterRouting::RouteOutput(Ptr<Packet> p, const Ipv4Header &header, Ptr<NetDevice> oif, Socket::SocketErrno &sockerr)
+{
+	Ptr<Ipv4Route> route = LookupRoute(header.GetDestination());
+	sockerr = route ? Socket::ERROR_NOTERROR : Socket::ERROR_NOROUTETOHOST;
+	return route;
+}
+
+bool ClusterRouting::RouteInput(Ptr<const Packet> p, const Ipv4Header &header, Ptr<const NetDevice> idev, UnicastForwardCallback ucb, MulticastForwardCallback mcb, LocalDeliverCallback lcb, ErrorCallback ecb)
+{
+	uint32_t iif = m_ipv4->GetInterfaceForDevice(idev);
+
+	if(m_ipv4->IsDestinationAddress(header.GetDestination(), iif))
+	{
+		if(lcb.IsNull())
+		{
+			return false;
+		}
+		lcb(p, header, iif);
+		return true;
+	}
+
+	if(!m_ipv4->IsForwarding(iif))
+	{
+		ecb(p, header, Socket::ERROR_NOROUTETOHOST);
+		return true;
+	}
+
+	Ptr<Ipv4Route> route = LookupRoute(header.GetDestination());
+	if(!route)
+	{
+		return false;
+	}
+	ucb(route, p, header);
+	return true;
+}
+
+void ClusterRouting::PrintRoutingTable(Ptr<OutputStreamWrapper> stream, Time::Unit unit) const
+{
+	std::ostream *os = stream->GetStream();
+	*os << "Node: " << m_nodeId << ", Time: " << Now().As(unit) << ", Cluster head: " << m_manager->GetHead(m_nodeId) << std::endl;
+}
+
+ClusterRoutingHelper::ClusterRoutingHelper(ClusterManager *manager)
+{
+	m_manager = manager;
+}
+
+ClusterRoutingHelper *ClusterRoutingHelper::Copy() const
+{
+	return new ClusterRoutingHelper(*this);
+}
+
+Ptr<Ipv4RoutingProtocol> ClusterRoutingHelper::Create(Ptr<Node> node) const
+{
+	Ptr<ClusterRouting> routing = CreateObject<ClusterRouting>();
+	routing->SetManager(m_manager, node->GetId());
+	return routing;
+}
+
+ClusterManager::ClusterManager()
+{
+	m_period = Seconds(1.0);
+	m_metric = 1;
+}
+
+//Node ids are used as table indices, so the container must hold every node of the simulation in creation order
+void ClusterManager::Install(NodeContainer nodes, Ipv4InterfaceContainer interfaces)
+{
+	uint32_t n = nodes.GetN();
+	m_sockets.resize(n);
+	m_addresses.resize(n);
+	m_neighbours.assign(n, std::map<uint32_t, Neighbour>());
+	m_clusters.assign(n, std::map<uint32_t, Cluster>());
+	m_previous.assign(n, std::set<uint32_t>());
+	m_head.assign(n, CLUSTER_NONE);
+	m_weight.assign(n, 0);
+	m_gateway.assign(n, false);
+	m_seq.assign(n, 0);
+	m_nextHop.assign(n, std::vector<int32_t>(n, -1));
+	m_jitter = CreateObject<UniformRandomVariable>();
+
+	for(uint32_t i = 0; i < n; i++)
+	{
+		NS_ASSERT_MSG(nodes.Get(i)->GetId() == i, "ClusterManager expects node ids to match container indices");
+		m_addresses[i] = interfaces.GetAddress(i);
+		m_index[m_addresses[i]] = i;
+
+		m_sockets[i] = Socket::CreateSocket(nodes.Get(i), UdpSocketFactory::GetTypeId());
+		m_sockets[i]->Bind(InetSocketAddress(Ipv4Address::GetAny(), CLUSTER_PORT));
+		m_sockets[i]->SetAllowBroadcast(true);
+		m_sockets[i]->SetRecvCallback(MakeCallback(&ClusterManager::ReceivePacket, this));
+	}
+}
+
+void ClusterManager::Start(double period, uint32_t metric)
+{
+	m_period = Seconds(period);
+	m_metric = metric;
+	for(uint32_t i = 0; i < m_sockets.size(); i++)
+	{
+		Simulator::ScheduleNow(&ClusterManager::Update, this, i);
+	}
+}
+
+bool ClusterManager::NextHop(uint32_t node, Ipv4Address dst, Ipv4Address &nextHop) const
+{
+	std::map<Ipv4Address, uint32_t>::const_iterator it = m_index.find(dst);
+	if(it == m_index.end() || node >= m_nextHop.size() || m_nextHop[node][it->second] < 0)
+	{
+		return false;
+	}
+	nextHop = m_addresses[m_nextHop[node][it->second]];
+	return true;
+}
+
+uint32_t ClusterManager::GetHead(uint32_t node) const
+{
+	return m_head[node];
+}
+
+uint32_t ClusterManager::GetNClusters() const
+{
+	uint32_t clusters = 0;
+	for(uint32_t i = 0; i < m_head.size(); i++)
+	{
+		clusters += (m_head[i] == i) ? 1 : 0;
+	}
+	return clusters;
+}
+
+//Ties go to the lowest id
+bool ClusterManager::Heavier(uint32_t weightA, uint32_t a, uint32_t weightB, uint32_t b)
+{
+	return weightA > weightB || (weightA == weightB && a < b);
+}
+
+//Runs once per period for every node: expire its tables, re-elect, rebuild its routes and send the next round of beacons
+void ClusterManager::Update(uint32_t node)
+{
+	Time holdTime = Seconds(m_period.GetSeconds() * 3); //Neighbours and clusters are dropped after three missed beacons
+
+	std::set<uint32_t> symmetric; //Neighbours that also hear this node, one way links would give routes the reverse path cannot follow
+	std::map<uint32_t, Neighbour>::iterator it = m_neighbours[node].begin();
+	while(it != m_neighbours[node].end())
+	{
+		if(Simulator::Now() - it->second.heard > holdTime)
+		{
+			m_neighbours[node].erase(it++);
+			continue;
+		}
+		if(it->second.links.count(node))
+		{
+			symmetric.insert(it->first);
+		}
+		++it;
+	}
+	std::map<uint32_t, Cluster>::iterator cluster = m_clusters[node].begin();
+	while(cluster != m_clusters[node].end())
+	{
+		if(Simulator::Now() - cluster->second.heard > holdTime)
+		{
+			m_clusters[node].erase(cluster++);
+		}
+		else
+		{
+			++cluster;
+		}
+	}
+
+	if(m_metric == 2) //Stability: neighbours that were also neighbours in the previous period
+	{
+		uint32_t stable = 0;
+		for(std::set<uint32_t>::iterator j = symmetric.begin(); j != symmetric.end(); ++j)
+		{
+			stable += m_previous[node].count(*j);
+		}
+		m_weight[node] = stable;
+	}
+	else //Connectivity: number of neighbours
+	{
+		m_weight[node] = symmetric.size();
+	}
+	m_previous[node] = symmetric;
+
+	Elect(node, symmetric);
+	BuildRoutes(node, symmetric);
+
+	Simulator::Schedule(Seconds(m_jitter->GetValue(0.0, m_period.GetSeconds() / 2)), &ClusterManager::SendHello, this, node);
+	if(m_head[node] == node && !symmetric.empty())
+	{
+		Simulator::Schedule(Seconds(m_jitter->GetValue(m_period.GetSeconds() / 2, m_period.GetSeconds())), &ClusterManager::SendAdvert, this, node);
+	}
+	Simulator::Schedule(m_period, &ClusterManager::Update, this, node);
+}
+
+//Distributed highest weight first clustering, from the heads and weights the neighbours announce in their HELLOs:
+//a node joins the heaviest neighbouring head, and becomes a head itself when no neighbour is a head and it is heavier than every
+//neighbour that has not joined another cluster. A head hands its cluster over to a heavier neighbouring head, so adjacent heads merge.
+void ClusterManager::Elect(uint32_t node, const std::set<uint32_t> &symmetric)
+{
+	uint32_t bestHead = CLUSTER_NONE;
+	uint32_t bestWeight = 0;
+	bool heaviest = true;
+	for(std::set<uint32_t>::const_iterator j = symmetric.begin(); j != symmetric.end(); ++j)
+	{
+		const Neighbour &entry = m_neighbours[node].find(*j)->second;
+		if(entry.head == *j && (bestHead == CLUSTER_NONE || Heavier(entry.weight, *j, bestWeight, bestHead)))
+		{
+			bestHead = *j;
+			bestWeight = entry.weight;
+		}
+		if((entry.head == *j || entry.head == CLUSTER_NONE) && Heavier(entry.weight, *j, m_weight[node], node))
+		{
+			heaviest = false;
+		}
+	}
+
+	uint32_t &head = m_head[node];
+	if(head == node)
+	{
+		if(bestHead != CLUSTER_NONE && Heavier(bestWeight, bestHead, m_weight[node], node))
+		{
+			head = bestHead;
+		}
+	}
+	else if(head != CLUSTER_NONE && symmetric.count(head) && m_neighbours[node].find(head)->second.head == head)
+	{
+		//Stay with the current head while it is a neighbour and still a head
+	}
+	else if(bestHead != CLUSTER_NONE)
+	{
+		head = bestHead;
+	}
+	else
+	{
+		head = heaviest ? node : CLUSTER_NONE;
+	}
+
+	m_gateway[node] = false;
+	for(std::set<uint32_t>::const_iterator j = symmetric.begin(); j != symmetric.end(); ++j)
+	{
+		uint32_t other = m_neighbours[node].find(*j)->second.head;
+		if(other != CLUSTER_NONE && other != head)
+		{
+			m_gateway[node] = true;
+		}
+	}
+}
+
+//Members of a head and the clusters bordering it, from the HELLOs the head received: neighbours that joined it are its members, and the
+//heads its members and its other neighbours report are the adjacent clusters
+void ClusterManager::Describe(uint32_t head, std::vector<uint32_t> &members, std::vector<uint32_t> &adjacent) const
+{
+	std::set<uint32_t> heads;
+	for(std::map<uint32_t, Neighbour>::const_iterator it = m_neighbours[head].begin(); it != m_neighbours[head].end(); ++it)
+	{
+		const Neighbour &entry = it->second;
+		if(!entry.links.count(head))
+		{
+			continue;
+		}
+		if(entry.head == head)
+		{
+			members.push_back(it->first);
+			for(std::map<uint32_t, uint32_t>::const_iterator link = entry.links.begin(); link != entry.links.end(); ++link)
+			{
+				if(link->second != CLUSTER_NONE && link->second != head)
+				{
+					heads.insert(link->second);
+				}
+			}
+		}
+		else if(entry.head != CLUSTER_NONE)
+		{
+			heads.insert(entry.head);
+		}
+	}
+	adjacent.assign(heads.begin(), heads.end());
+}
+
+//Next hop of one node towards every destination it knows a cluster for. Direct neighbours are delivered to directly, members of the own
+//cluster through the head, everything else towards the first cluster on the shortest cluster path of the advertised cluster graph
+void ClusterManager::BuildRoutes(uint32_t node, const std::set<uint32_t> &symmetric)
+{
+	std::vector<int32_t> &row = m_nextHop[node];
+	std::fill(row.begin(), row.end(), -1);
+	uint32_t own = m_head[node];
+
+	std::map<uint32_t, uint32_t> clusterOf;
+	std::map<uint32_t, std::set<uint32_t> > graph;
+	for(std::map<uint32_t, Cluster>::const_iterator it = m_clusters[node].begin(); it != m_clusters[node].end(); ++it)
+	{
+		clusterOf[it->first] = it->first;
+		for(uint32_t i = 0; i < it->second.members.size(); i++)
+		{
+			clusterOf[it->second.members[i]] = it->first;
+		}
+		for(uint32_t i = 0; i < it->second.adjacent.size(); i++)
+		{
+			graph[it->first].insert(it->second.adjacent[i]);
+			graph[it->second.adjacent[i]].insert(it->first);
+		}
+	}
+	if(own == node)
+	{
+		std::vector<uint32_t> members;
+		std::vector<uint32_t> adjacent;
+		Describe(node, members, adjacent);
+		for(uint32_t i = 0; i < adjacent.size(); i++)
+		{
+			graph[node].insert(adjacent[i]);
+			graph[adjacent[i]].insert(node);
+		}
+	}
+	for(std::set<uint32_t>::const_iterator j = symmetric.begin(); j != symmetric.end(); ++j)
+	{
+		uint32_t head = m_neighbours[node].find(*j)->second.head;
+		if(head != CLUSTER_NONE)
+		{
+			clusterOf[*j] = head;
+			if(own != CLUSTER_NONE && head != own)
+			{
+				graph[own].insert(head);
+				graph[head].insert(own);
+			}
+		}
+	}
+
+	//Breadth first search over the clusters: the first cluster on the path towards each of them
+	std::map<uint32_t, uint32_t> via;
+	if(own != CLUSTER_NONE)
+	{
+		std::queue<uint32_t> pending;
+		via[own] = own;
+		pending.push(own);
+		while(!pending.empty())
+		{
+			uint32_t c = pending.front();
+			pending.pop();
+			const std::set<uint32_t> &next = graph[c];
+			for(std::set<uint32_t>::const_iterator a = next.begin(); a != next.end(); ++a)
+			{
+				if(!via.count(*a))
+				{
+					via[*a] = (c == own) ? *a : via[c];
+					pending.push(*a);
+				}
+			}
+		}
+	}
+
+	for(uint32_t dst = 0; dst < row.size(); dst++)
+	{
+		if(dst == node)
+		{
+			continue;
+		}
+		if(symmetric.count(dst))
+		{
+			row[dst] = dst;
+			continue;
+		}
+		std::map<uint32_t, uint32_t>::const_iterator target = clusterOf.find(dst);
+		if(target == clusterOf.end() || own == CLUSTER_NONE)
+		{
+			continue;
+		}
+		if(target->second == own)
+		{
+			row[dst] = (own != node && symmetric.count(own)) ? int32_t(own) : -1;
+		}
+		else if(via.count(target->second))
+		{
+			row[dst] = TowardsCluster(node, symmetric, via[target->second]);
+		}
+	}
+}
+
+//Neighbour to hand a packet to so it reaches the given adjacent cluster: its head or another of its nodes if in range,
+//otherwise a member's own head, and a head picks the member that reported a link into that cluster
+int32_t ClusterManager::TowardsCluster(uint32_t node, const std::set<uint32_t> &symmetric, uint32_t cluster) const
+{
+	if(symmetric.count(cluster))
+	{
+		return cluster;
+	}
+	for(std::set<uint32_t>::const_iterator j = symmetric.begin(); j != symmetric.end(); ++j)
+	{
+		if(m_neighbours[node].find(*j)->second.head == cluster)
+		{
+			return *j;
+		}
+	}
+	uint32_t own = m_head[node];
+	if(own != node)
+	{
+		return symmetric.count(own) ? int32_t(own) : -1;
+	}
+	for(std::set<uint32_t>::const_iterator j = symmetric.begin(); j != symmetric.end(); ++j)
+	{
+		const Neighbour &entry = m_neighbours[node].find(*j)->second;
+		if(entry.head != node)
+		{
+			continue;
+		}
+		for(std::map<uint32_t, uint32_t>::const_iterator link = entry.links.begin(); link != entry.links.end(); ++link)
+		{
+			if(link->second == cluster)
+			{
+				return *j;
+			}
+		}
+	}
+	return -1;
+}
+
+//HELLO: type(1) | node(4) | head(4) | weight(4) | count(4) | count x (neighbour(4) | neighbour's head(4))
+void ClusterManager::SendHello(uint32_t node)
+{
+	const std::map<uint32_t, Neighbour> &neighbours = m_neighbours[node];
+	m_advertBuffer.resize(17 + 8 * neighbours.size());
+	m_advertBuffer[0] = 1;
+	WriteU32(&m_advertBuffer[1], node);
+	WriteU32(&m_advertBuffer[5], m_head[node]);
+	WriteU32(&m_advertBuffer[9], m_weight[node]);
+	WriteU32(&m_advertBuffer[13], neighbours.size());
+	uint32_t offset = 17;
+	for(std::map<uint32_t, Neighbour>::const_iterator it = neighbours.begin(); it != neighbours.end(); ++it)
+	{
+		WriteU32(&m_advertBuffer[offset], it->first);
+		WriteU32(&m_advertBuffer[offset + 4], it->second.head);
+		offset += 8;
+	}
+	Forward(node, Create<Packet>(&m_advertBuffer[0], m_advertBuffer.size()));
+}
+
+//Advertisement: type(1) | head(4) | sequence(4) | members(4) | member ids(4 each) | adjacent(4) | adjacent head ids(4 each)
+void ClusterManager::SendAdvert(uint32_t head)
+{
+	if(m_head[head] != head)
+	{
+		return;
+	}
+	std::vector<uint32_t> members;
+	std::vector<uint32_t> adjacent;
+	Describe(head, members, adjacent);
+
+	m_advertBuffer.resize(17 + 4 * (members.size() + adjacent.size()));
+	m_advertBuffer[0] = 2;
+	WriteU32(&m_advertBuffer[1], head);
+	WriteU32(&m_advertBuffer[5], ++m_seq[head]);
+	WriteU32(&m_advertBuffer[9], members.size());
+	uint32_t offset = 13;
+	for(uint32_t i = 0; i < members.size(); i++, offset += 4)
+	{
+		WriteU32(&m_advertBuffer[offset], members[i]);
+	}
+	WriteU32(&m_advertBuffer[offset], adjacent.size());
+	offset += 4;
+	for(uint32_t i = 0; i < adjacent.size(); i++, offset += 4)
+	{
+		WriteU32(&m_advertBuffer[offset], adjacent[i]);
+	}
+	Forward(head, Create<Packet>(&m_advertBuffer[0], m_advertBuffer.size()));
+}
+
+void ClusterManager::Forward(uint32_t node, Ptr<Packet> packet)
+{
+	m_sockets[node]->SendTo(packet, 0, InetSocketAddress(Ipv4Address::GetBroadcast(), CLUSTER_PORT));
+}
+
+void ClusterManager::ReceivePacket(Ptr<Socket> socket)
+{
+	uint32_t node = socket->GetNode()->GetId();
+	Ptr<Packet> packet;
+	Address senderAddress;
+	while((packet = socket->RecvFrom(senderAddress)))
+	{
+		uint32_t length = packet->GetSize();
+		if(length == 0)
+		{
+			continue;
+		}
+		m_receiveBuffer.resize(length);
+		packet->CopyData(&m_receiveBuffer[0], length);
+
+		if(m_receiveBuffer[0] == 1)
+		{
+			ReceiveHello(node, &m_receiveBuffer[0], length);
+		}
+		else if(m_receiveBuffer[0] == 2)
+		{
+			ReceiveAdvert(node, packet, &m_receiveBuffer[0], length);
+		}
+	}
+}
+
+void ClusterManager::ReceiveHello(uint32_t node, const uint8_t *data, uint32_t length)
+{
+	if(length < 17 || length < 17 + 8 * uint64_t(ReadU32(data + 13)))
+	{
+		return;
+	}
+	Neighbour &entry = m_neighbours[node][ReadU32(data + 1)];
+	entry.heard = Simulator::Now();
+	entry.head = ReadU32(data + 5);
+	entry.weight = ReadU32(data + 9);
+	entry.links.clear();
+	uint32_t count = ReadU32(data + 13);
+	for(uint32_t i = 0; i < count; i++)
+	{
+		entry.links[ReadU32(data + 17 + 8 * i)] = ReadU32(data + 21 + 8 * i);
+	}
+}
+
+//Every node keeps the newest advertisement of each head. Heads and gateways rebroadcast it once, plain members only listen
+void ClusterManager::ReceiveAdvert(uint32_t node, Ptr<Packet> packet, const uint8_t *data, uint32_t length)
+{
+	if(length < 17)
+	{
+		return;
+	}
+	uint32_t head = ReadU32(data + 1);
+	uint32_t seq = ReadU32(data + 5);
+	uint32_t nMembers = ReadU32(data + 9);
+	if(head == node || length < 17 + 4 * uint64_t(nMembers))
+	{
+		return;
+	}
+	uint32_t nAdjacent = ReadU32(data + 13 + 4 * nMembers);
+	if(length < 17 + 4 * (uint64_t(nMembers) + nAdjacent))
+	{
+		return;
+	}
+	std::map<uint32_t, Cluster>::iterator known = m_clusters[node].find(head);
+	if(known != m_clusters[node].end() && known->second.seq >= seq)
+	{
+		return;
+	}
+
+	Cluster &cluster = m_clusters[node][head];
+	cluster.heard = Simulator::Now();
+	cluster.seq = seq;
+	cluster.members.resize(nMembers);
+	for(uint32_t i = 0; i < nMembers; i++)
+	{
+		cluster.members[i] = ReadU32(data + 13 + 4 * i);
+	}
+	cluster.adjacent.resize(nAdjacent);
+	for(uint32_t i = 0; i < nAdjacent; i++)
+	{
+		cluster.adjacent[i] = ReadU32(data + 17 + 4 * (nMembers + i));
+	}
+
+	if(m_head[node] == node || m_gateway[node])
+	{
+		Simulator::Schedule(MilliSeconds(m_jitter->GetValue(0.0, 10.0)), &ClusterManager::Forward, this, node, packet);
+	}
+}
+
+//-----------------------------------------------------------------------------
+//Telemetry aggregation application
+//Every UAV samples fixed size telemetry records and batches them for a time window, then sends a single packet towards the ground station.
+//A collector also listens for the batches of other UAVs and merges their records into its own batch, so relays forward one packet instead of many.
+//Batch: count(2) | records. Record: origin(4) | sequence(4) | sample time in ns(8) | zero padding up to the record size
+#define TELEMETRY_PORT 10 //UDP port the collectors listen on
+#define TELEMETRY_MAX_BATCH 1400 //Largest batch in bytes, a full batch is sent before the window ends
+
+class TelemetryAggregator : public Application
+{
+	public:
+		static TypeId GetTypeId();
+		TelemetryAggregator();
+		void Setup(Address remote, uint32_t recordSize, double recordRate, double window, bool collector);
+		static uint32_t Decode(Ptr<Packet> packet, uint32_t recordSize, Time &delaySum, std::vector<uint8_t> &scratch);
+
+	private:
+		void StartApplication();
+		void StopApplication();
+		void Sample();
+		void Flush();
+		void AppendRecord(const uint8_t *record);
+		void ReceiveBatch(Ptr<Socket> socket);
+
+		Ptr<Socket> m_socket; //Sends the batches
+		Ptr<Socket> m_listenSocket; //Receives the batches of other UAVs (collectors only)
+		Address m_remote;
+		uint32_t m_recordSize;
+		Time m_recordInterval;
+		Time m_window;
+		bool m_collector;
+		uint32_t m_seq;
+		std::vector<uint8_t> m_batch; //Records waiting for the next flush
+		std::vector<uint8_t> m_record; //Reused for every sampled record
+		std::vector<uint8_t> m_received; //Reused for every merged batch
+		EventId m_sampleEvent;
+		EventId m_flushEvent;
+};
+
+TypeId TelemetryAggregator::GetTypeId()
+{
+	static TypeId tid = TypeId("ns3::TelemetryAggregator")
+		.SetParent<Application>()
+		.SetGroupName("Applications")
+		.AddConstructor<TelemetryAggregator>();
+	return tid;
+}
+
+TelemetryAggregator::TelemetryAggregator()
+{
+	m_recordSize = 64;
+	m_recordInterval = Seconds(0.05);
+	m_window = Seconds(0.1);
+	m_collector = false;
+	m_seq = 0;
+}
+
+void TelemetryAggregator::Setup(Address remote, uint32_t recordSize, double recordRate, double window, bool collector)
+{
+	m_remote = remote;
+	m_recordSize = std::max(recordSize, uint32_t(16)); //Room for the record header
+	m_recordInterval = Seconds(1.0 / recordRate);
+	m_window = Seconds(window);
+	m_collector = collector;
+	m_batch.reserve(TELEMETRY_MAX_BATCH);
+	m_received.reserve(TELEMETRY_MAX_BATCH);
+	m_record.assign(m_recordSize, 0);
+}
+
+//Count the records of a batch and add up their age, used by the ground station. The scratch buffer is kept by the caller across packets
+uint32_t TelemetryAggregator::Decode(Ptr<Packet> packet, uint32_t recordSize, Time &delaySum, std::vector<uint8_t> &scratch)
+{
+	recordSize = std::max(recordSize, uint32_t(16));
+	std::vector<uint8_t> &data = scratch;
+	data.resize(packet->GetSize());
+	if(data.size() < 2)
+	{
+		return 0;
+	}
+	packet->CopyData(&data[0], data.size());
+
+	uint32_t count = (uint32_t(data[0]) << 8) | data[1];
+	count = std::min(count, uint32_t((data.size() - 2) / recordSize));
+	for(uint32_t i = 0; i < count; i++)
+	{
+		delaySum += Simulator::Now() - NanoSeconds(ReadU64(&data[2 + i * recordSize + 8]));
+	}
+	return count;
+}
+
+void TelemetryAggregator::StartApplication()
+{
+	m_socket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
+	m_socket->Bind();
+	m_socket->Connect(m_remote);
+
+	if(m_collector)
+	{
+		m_listenSocket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
+		m_listenSocket->Bind(InetSocketAddress(Ipv4Address::GetAny(), TELEMETRY_PORT));
+		m_listenSocket->SetRecvCallback(MakeCallback(&TelemetryAggregator::ReceiveBatch, this));
+	}
+
+	m_batch.assign(2, 0);
+	Ptr<UniformRandomVariable> offset = CreateObject<UniformRandomVariable>(); //Keeps the UAVs from sampling in lockstep
+	m_sampleEvent = Simulator::Schedule(Seconds(offset->GetValue(0.0, m_recordInterval.GetSeconds())), &TelemetryAggregator::Sample, this);
+	m_flushEvent = Simulator::Schedule(m_window, &TelemetryAggregator::Flush, this);
+}
+
+void TelemetryAggregator::StopApplication()
+{
+	Simulator::Cancel(m_sampleEvent);
+	Simulator::Cancel(m_flushEvent);
+	if(m_socket)
+	{
+		m_socket->Close();
+	}
+	if(m_listenSocket)
+	{
+		m_listenSocket->Close();
+		m_listenSocket->SetRecvCallback(MakeNullCallback<void, Ptr<Socket> >());
+	}
+}
+
+void TelemetryAggregator::Sample()
+{
+	WriteU32(&m_record[0], GetNode()->GetId());
+	WriteU32(&m_record[4], m_seq++);
+	WriteU64(&m_record[8], Simulator::Now().GetNanoSeconds());
+	AppendRecord(&m_record[0]);
+
+	m_sampleEvent = Simulator::Schedule(m_recordInterval, &TelemetryAggregator::Sample, this);
+}
+
+void TelemetryAggregator::AppendRecord(const uint8_t *record)
+{
+	if(m_batch.size() + m_recordSize > TELEMETRY_MAX_BATCH)
+	{
+		Simulator::Cancel(m_flushEvent);
+		Flush();
+	}
+	m_batch.insert(m_batch.end(), record, record + m_recordSize);
+}
+
+void TelemetryAggregator::Flush()
+{
+	uint32_t count = (m_batch.size() - 2) / m_recordSize;
+	if(count > 0)
+	{
+		m_batch[0] = (count >> 8) & 0xff;
+		m_batch[1] = count & 0xff;
+		m_socket->Send(Create<Packet>(&m_batch[0], m_batch.size()));
+		m_batch.resize(2);
+	}
+	m_flushEvent = Simulator::Schedule(m_window, &TelemetryAggregator::Flush, this);
+}
+
+//Merge the records of another UAV into the next batch, they keep their origin and sample time
+void TelemetryAggregator::ReceiveBatch(Ptr<Socket> socket)
+{
+	Ptr<Packet> packet;
+	while((packet = socket->Recv()))
+	{
+		m_received.resize(packet->GetSize());
+		if(m_received.size() < 2)
+		{
+			continue;
+		}
+		packet->CopyData(&m_received[0], m_received.size());
+
+		uint32_t count = std::min((uint32_t(m_received[0]) << 8) | m_received[1], uint32_t((m_received.size() - 2) / m_recordSize));
+		for(uint32_t i = 0; i < count; i++)
+		{
+			AppendRecord(&m_received[2 + i * m_recordSize]);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+//Edge offload pipeline
+//Every offloading UAV produces sensor frames with a deadline. For each frame a scheduler picks local processing (single CPU, FIFO queue)
+//or offloading to its ground station, which reassembles the frame, processes it on its own CPU queue and returns a small result.
+//Chunk: type(1) | origin(4) | frame(4) | chunk(2) | chunks(2) | zero padding. Result: type(1) | frame(4) | zero padding
+#define OFFLOAD_PORT 11 //UDP port the ground stations listen on
+#define OFFLOAD_CHUNK 1400 //Largest frame chunk in bytes
+#define OFFLOAD_RESULT 64 //Result size in bytes
+#define OFFLOAD_ESTIMATE_DECAY 0.9 //The adaptive offload estimate shrinks by this factor for every frame processed locally
+#define OFFLOAD_RESULT_WAIT 10 //Deadlines an offloaded frame waits for its result before it is counted as lost
+
+class EdgeOffloadClient : public Application
+{
+	public:
+		static TypeId GetTypeId();
+		EdgeOffloadClient();
+		void Setup(Address server, uint32_t policy, uint32_t frameSize, double frameRate, double deadline, double processingRate);
+		uint32_t GetFramesGenerated() const;
+		uint32_t GetFramesLost() const;
+
+		typedef void (*FrameDoneCallback)(Time latency, bool offloaded, bool deadlineMet);
+
+	private:
+		void StartApplication();
+		void StopApplication();
+		void GenerateFrame();
+		void ProcessLocally(uint32_t frame);
+		void Offload(uint32_t frame);
+		void FrameDone(uint32_t frame, bool offloaded);
+		void FrameTimeout(uint32_t frame);
+		void FrameLost(uint32_t frame);
+		void ReceiveResult(Ptr<Socket> socket);
+
+		Ptr<Socket> m_socket;
+		Address m_server;
+		uint32_t m_policy; //1=Local;2=Ground;3=Adaptive
+		uint32_t m_frameSize;
+		Time m_frameInterval;
+		Time m_deadline;
+		double m_processingRate; //Bytes processed per second by the UAV CPU
+		Time m_busyUntil; //Time the local CPU finishes its queue
+		Time m_offloadEstimate; //Moving average of the offload completion time
+		uint32_t m_frameId;
+		uint32_t m_generated;
+		uint32_t m_lost; //Offloaded frames whose result never arrived
+		std::map<uint32_t, Time> m_created; //Frames waiting for their result -> creation time
+		std::map<uint32_t, EventId> m_timeouts; //Offloaded frames -> deadline event, then the event that gives up on the result
+		Ptr<Packet> m_padding; //Zero filled body of a full chunk, shared by every chunk
+		Ptr<Packet> m_lastPadding; //Zero filled body of the last chunk of a frame
+		EventId m_frameEvent;
+		TracedCallback<Time, bool, bool> m_frameDoneTrace; //Latency, offloaded, deadline met
+};
+
+class EdgeOffloadServer : public Application
+{
+	public:
+		static TypeId GetTypeId();
+		EdgeOffloadServer();
+		void Setup(uint32_t frameSize, double processingRate, double deadline);
+
+	private:
+		void StartApplication();
+		void StopApplication();
+		void ReceiveChunk(Ptr<Socket> socket);
+		void SendResult(Address client, uint32_t frame);
+		void ExpireChunks();
+
+		Ptr<Socket> m_socket;
+		uint32_t m_frameSize;
+		double m_processingRate; //Bytes processed per second by the ground station CPU
+		Time m_deadline; //Frame deadline, incomplete frames are swept every deadline
+		Time m_busyUntil;
+		std::map<std::pair<uint32_t, uint32_t>, std::pair<uint32_t, Time> > m_chunks; //(origin, frame) -> chunks received so far, first chunk time
+		EventId m_expireEvent;
+};
+
+TypeId EdgeOffloadClient::GetTypeId()
+{
+	static TypeId tid = TypeId("ns3::EdgeOffloadClient")
+		.SetParent<Application>()
+		.SetGroupName("Applications")
+		.AddConstructor<EdgeOffloadClient>()
+		.AddTraceSource("FrameDone", "A frame finished or missed its deadline", MakeTraceSourceAccessor(&EdgeOffloadClient::m_frameDoneTrace), "ns3::EdgeOffloadClient::FrameDoneCallback");
+	return tid;
+}
+
+EdgeOffloadClient::EdgeOffloadClient()
+{
+	m_policy = 3;
+	m_frameSize = 20000;
+	m_frameInterval = Seconds(0.1);
+	m_deadline = Seconds(0.2);
+	m_processingRate = 100000.0;
+	m_frameId = 0;
+	m_generated = 0;
+	m_lost = 0;
+}
+
+void EdgeOffloadClient::Setup(Address server, uint32_t policy, uint32_t frameSize, double frameRate, double deadline, double processingRate)
+{
+	NS_ABORT_MSG_IF(frameSize == 0, "The offload frame size must be at least one byte");
+	m_server = server;
+	m_policy = policy;
+	m_frameSize = frameSize;
+	m_frameInterval = Seconds(1.0 / frameRate);
+	m_deadline = Seconds(deadline);
+	m_processingRate = processingRate;
+
+	//Zero filled packets only store their size, and AddAtEnd keeps them that way, so no chunk carries real padding bytes
+	uint32_t lastChunk = m_frameSize - (m_frameSize - 1) / OFFLOAD_CHUNK * OFFLOAD_CHUNK;
+	m_padding = Create<Packet>(OFFLOAD_CHUNK - 13);
+	m_lastPadding = Create<Packet>(lastChunk > 13 ? lastChunk - 13 : 0);
+}
+
+uint32_t EdgeOffloadClient::GetFramesGenerated() const
+{
+	return m_generated;
+}
+
+uint32_t EdgeOffloadClient::GetFramesLost() const
+{
+	return m_lost;
+}
+
+void EdgeOffloadClient::StartApplication()
+{
+	m_socket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
+	m_socket->Bind();
+	m_socket->Connect(m_server);
+	m_socket->SetRecvCallback(MakeCallback(&EdgeOffloadClient::ReceiveResult, this));
+
+	m_busyUntil = Simulator::Now();
+	m_frameEvent = Simulator::ScheduleNow(&EdgeOffloadClient::GenerateFrame, this);
+}
+
+void EdgeOffloadClient::StopApplication()
+{
+	Simulator::Cancel(m_frameEvent);
+	for(std::map<uint32_t, EventId>::iterator it = m_timeouts.begin(); it != m_timeouts.end(); ++it)
+	{
+		Simulator::Cancel(it->second);
+	}
+	if(m_socket)
+	{
+		m_socket->Close();
+		m_socket->SetRecvCallback(MakeNullCallback<void, Ptr<Socket> >());
+	}
+}
+
+//Adaptive policy: offload when the expected offload time beats the local queue, the estimate starts at zero so the first frames probe the network.
+//Only offloaded frames measure the network, so the estimate decays while frames stay local and the network is probed again after a while
+void EdgeOffloadClient::GenerateFrame()
+{
+	uint32_t frame = m_frameId++;
+	m_generated++;
+	m_created[frame] = Simulator::Now();
+
+	Time localEstimate = std::max(m_busyUntil, Simulator::Now()) - Simulator::Now() + Seconds(m_frameSize / m_processingRate);
+	bool offload = (m_policy == 2) || (m_policy == 3 && m_offloadEstimate < localEstimate);
+	if(offload)
+	{
+		Offload(frame);
+	}
+	else
+	{
+		ProcessLocally(frame);
+		if(m_policy == 3)
+		{
+			m_offloadEstimate = Seconds(m_offloadEstimate.GetSeconds() * OFFLOAD_ESTIMATE_DECAY);
+		}
+	}
+
+	m_frameEvent = Simulator::Schedule(m_frameInterval, &EdgeOffloadClient::GenerateFrame, this);
+}
+
+void EdgeOffloadClient::ProcessLocally(uint32_t frame)
+{
+	m_busyUntil = std::max(m_busyUntil, Simulator::Now()) + Seconds(m_frameSize / m_processingRate);
+	Simulator::Schedule(m_busyUntil - Simulator::Now(), &EdgeOffloadClient::FrameDone, this, frame, false);
+}
+
+void EdgeOffloadClient::Offload(uint32_t frame)
+{
+	uint32_t chunks = (m_frameSize + OFFLOAD_CHUNK - 1) / OFFLOAD_CHUNK;
+	uint8_t header[13];
+	header[0] = 1;
+	WriteU32(header + 1, GetNode()->GetId());
+	WriteU32(header + 5, frame);
+	header[11] = (chunks >> 8) & 0xff;
+	header[12] = chunks & 0xff;
+
+	for(uint32_t i = 0; i < chunks; i++)
+	{
+		header[9] = (i >> 8) & 0xff;
+		header[10] = i & 0xff;
+		Ptr<Packet> chunk = Create<Packet>(header, sizeof(header));
+		chunk->AddAtEnd(i + 1 < chunks ? m_padding : m_lastPadding);
+		m_socket->Send(chunk);
+	}
+	m_timeouts[frame] = Simulator::Schedule(m_deadline, &EdgeOffloadClient::FrameTimeout, this, frame);
+}
+
+void EdgeOffloadClient::FrameDone(uint32_t frame, bool offloaded)
+{
+	std::map<uint32_t, Time>::iterator it = m_created.find(frame);
+	if(it == m_created.end())
+	{
+		return; //Already counted as lost
+	}
+	Time latency = Simulator::Now() - it->second;
+	m_created.erase(it);
+
+	if(offloaded)
+	{
+		m_offloadEstimate = m_offloadEstimate.IsZero() ? latency : Seconds(0.8 * m_offloadEstimate.GetSeconds() + 0.2 * latency.GetSeconds());
+	}
+	m_frameDoneTrace(latency, offloaded, latency <= m_deadline);
+}
+
+//An offloaded frame without a result by its deadline is a miss, the estimate is pushed up so the adaptive policy backs off right away.
+//The frame keeps waiting, so a late result is reported with its real latency like a late local frame
+void EdgeOffloadClient::FrameTimeout(uint32_t frame)
+{
+	m_offloadEstimate = Seconds(0.8 * m_offloadEstimate.GetSeconds() + 0.4 * m_deadline.GetSeconds());
+	m_timeouts[frame] = Simulator::Schedule(Seconds(m_deadline.GetSeconds() * (OFFLOAD_RESULT_WAIT - 1)), &EdgeOffloadClient::FrameLost, this, frame);
+}
+
+//No result after OFFLOAD_RESULT_WAIT deadlines, a chunk or the result was dropped. Lost frames have no latency and are counted apart
+void EdgeOffloadClient::FrameLost(uint32_t frame)
+{
+	m_timeouts.erase(frame);
+	m_created.erase(frame);
+	m_lost++;
+}
+
+void EdgeOffloadClient::ReceiveResult(Ptr<Socket> socket)
+{
+	Ptr<Packet> packet;
+	while((packet = socket->Recv()))
+	{
+		uint8_t result[5];
+		if(packet->GetSize() < sizeof(result))
+		{
+			continue;
+		}
+		packet->CopyData(result, sizeof(result));
+		uint32_t frame = ReadU32(result + 1);
+
+		std::map<uint32_t, EventId>::iterator timeout = m_timeouts.find(frame);
+		if(timeout == m_timeouts.end())
+		{
+			continue; //The frame was already counted as lost
+		}
+		Simulator::Cancel(timeout->second);
+		m_timeouts.erase(timeout);
+		FrameDone(frame, true);
+	}
+}
+
+TypeId EdgeOffloadServer::GetTypeId()
+{
+	static TypeId tid = TypeId("ns3::EdgeOffloadServer")
+		.SetParent<Application>()
+		.SetGroupName("Applications")
+		.AddConstructor<EdgeOffloadServer>();
+	return tid;
+}
+
+EdgeOffloadServer::EdgeOffloadServer()
+{
+	m_frameSize = 20000;
+	m_processingRate = 1000000.0;
+	m_deadline = Seconds(0.2);
+}
+
+void EdgeOffloadServer::Setup(uint32_t frameSize, double processingRate, double deadline)
+{
+	m_frameSize = frameSize;
+	m_processingRate = processingRate;
+	m_deadline = Seconds(deadline);
+}
+
+void EdgeOffloadServer::StartApplication()
+{
+	m_socket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
+	m_socket->Bind(InetSocketAddress(Ipv4Address::GetAny(), OFFLOAD_PORT));
+	m_socket->SetRecvCallback(MakeCallback(&EdgeOffloadServer::ReceiveChunk, this));
+	m_busyUntil = Simulator::Now();
+	m_expireEvent = Simulator::Schedule(m_deadline, &EdgeOffloadServer::ExpireChunks, this);
+}
+
+void EdgeOffloadServer::StopApplication()
+{
+	Simulator::Cancel(m_expireEvent);
+	if(m_socket)
+	{
+		m_socket->Close();
+		m_socket->SetRecvCallback(MakeNullCallback<void, Ptr<Socket> >());
+	}
+}
+
+//Once every chunk of a frame is in, the frame joins the CPU queue and its result is sent when processing ends
+void EdgeOffloadServer::ReceiveChunk(Ptr<Socket> socket)
+{
+	Ptr<Packet> packet;
+	Address from;
+	while((packet = socket->RecvFrom(from)))
+	{
+		uint8_t header[13];
+		if(packet->GetSize() < sizeof(header))
+		{
+			continue;
+		}
+		packet->CopyData(header, sizeof(header));
+		std::pair<uint32_t, uint32_t> key(ReadU32(header + 1), ReadU32(header + 5));
+		uint32_t chunks = (uint32_t(header[11]) << 8) | header[12];
+
+		std::map<std::pair<uint32_t, uint32_t>, std::pair<uint32_t, Time> >::iterator entry = m_chunks.find(key);
+		if(entry == m_chunks.end())
+		{
+			entry = m_chunks.insert(std::make_pair(key, std::make_pair(0u, Simulator::Now()))).first;
+		}
+		if(++entry->second.first < chunks)
+		{
+			continue;
+		}
+		m_chunks.erase(entry);
+		m_busyUntil = std::max(m_busyUntil, Simulator::Now()) + Seconds(m_frameSize / m_processingRate);
+		Simulator::Schedule(m_busyUntil - Simulator::Now(), &EdgeOffloadServer::SendResult, this, from, key.second);
+	}
+}
+
+//A frame still missing chunks OFFLOAD_RESULT_WAIT deadlines after its first chunk arrived lost one of them. Its client has given up on it
+//by then, so the entry is dropped instead of being kept for the rest of the run
+void EdgeOffloadServer::ExpireChunks()
+{
+	Time oldest = Simulator::Now() - Seconds(m_deadline.GetSeconds() * OFFLOAD_RESULT_WAIT);
+	for(std::map<std::pair<uint32_t, uint32_t>, std::pair<uint32_t, Time> >::iterator it = m_chunks.begin(); it != m_chunks.end();)
+	{
+		if(it->second.second <= oldest)
+		{
+			m_chunks.erase(it++);
+		}
+		else
+		{
+			++it;
+		}
+	}
+	m_expireEvent = Simulator::Schedule(m_deadline, &EdgeOffloadServer::ExpireChunks, this);
+}
+
+void EdgeOffloadServer::SendResult(Address client, uint32_t frame)
+{
+	uint8_t result[OFFLOAD_RESULT] = {0};
+	result[0] = 2;
+	WriteU32(result + 1, frame);
+	m_socket->SendTo(Create<Packet>(result, sizeof(result)), 0, client);
+}
+
+//-----------------------------------------------------------------------------
+//ArduPilot SITL driven mobility
+//Each driven node listens on a loopback UDP port (basePort + node * portStride) for the MAVLink stream of one SITL instance,
+//e.g. sim_vehicle.py -I <node> --out=udp:127.0.0.1:<port>. GLOBAL_POSITION_INT messages set the position and velocity of the node's
+//ConstantVelocityMobilityModel, so the node keeps moving between messages. The sockets are polled from a simulator event with a fixed
+//receive buffer, and the poll also measures how far the simulation lags behind the wall clock.
+#define MAVLINK_MSG_GLOBAL_POSITION_INT 33
+#define MAVLINK_CRC_EXTRA_GLOBAL_POSITION_INT 104
+#define MAVLINK_GLOBAL_POSITION_INT_LEN 28
+
+class MavlinkMobility
+{
+	public:
+		MavlinkMobility();
+		void Install(NodeContainer nodes, uint32_t instances, uint16_t basePort, uint16_t portStride);
+		void Start(double pollInterval, double jitterBound);
+		void Close();
+		void PrintStats(std::ostream &os) const;
+
+	private:
+		void Poll();
+		void HandleDatagram(uint32_t node, const uint8_t *data, uint32_t length);
+		void ApplyPosition(uint32_t node, const uint8_t *payload);
+
+		std::vector<int> m_fds; //Loopback UDP socket of every driven node
+		std::vector<Ptr<ConstantVelocityMobilityModel> > m_models;
+		uint8_t m_buffer[2048]; //Receive buffer reused for every datagram
+		bool m_haveOrigin; //The first fix becomes the local (0, 0) point
+		double m_originLat;
+		double m_originLon;
+		Time m_pollInterval;
+		Time m_jitterBound; //Lateness above this counts as a pacing violation
+		EventId m_pollEvent;
+		uint64_t m_messages; //GLOBAL_POSITION_INT messages applied
+		uint64_t m_badFrames; //Frames dropped for a bad CRC or length
+		uint64_t m_samples; //Lateness samples taken
+		uint64_t m_lateSamples; //Samples later than the jitter bound
+		double m_latenessSum; //Seconds
+		double m_latenessMax; //Seconds
+};
+
+//MAVLink X.25 checksum
+static inline uint16_t MavlinkCrc(const uint8_t *data, uint32_t length, uint16_t crc)
+{
+	for(uint32_t i = 0; i < length; i++)
+	{
+		uint8_t tmp = data[i] ^ (crc & 0xff);
+		tmp ^= (tmp << 4);
+		crc = (crc >> 8) ^ (uint16_t(tmp) << 8) ^ (uint16_t(tmp) << 3) ^ (tmp >> 4);
+	}
+	return crc;
+}
+
+//MAVLink payloads are little endian
+static inline uint32_t ReadLe32(const uint8_t *buffer)
+{
+	return uint32_t(buffer[0]) | (uint32_t(buffer[1]) << 8) | (uint32_t(buffer[2]) << 16) | (uint32_t(buffer[3]) << 24);
+}
+
+static inline uint16_t ReadLe16(const uint8_t *buffer)
+{
+	return uint16_t(buffer[0]) | (uint16_t(buffer[1]) << 8);
+}
+
+MavlinkMobility::MavlinkMobility()
+{
+	m_haveOrigin = false;
+	m_originLat = 0.0;
+	m_originLon = 0.0;
+	m_pollInterval = MilliSeconds(20);
+	m_jitterBound = MilliSeconds(50);
+	m_messages = 0;
+	m_badFrames = 0;
+	m_samples = 0;
+	m_lateSamples = 0;
+	m_latenessSum = 0.0;
+	m_latenessMax = 0.0;
+}
+
+//The nodes must already have a ConstantVelocityMobilityModel, nodes past the number of instances keep their initial position
+void MavlinkMobility::Install(NodeContainer nodes, uint32_t instances, uint16_t basePort, uint16_t portStride)
+{
+	instances = std::min(instances, nodes.GetN());
+	for(uint32_t i = 0; i < instances; i++)
+	{
+		Ptr<ConstantVelocityMobilityModel> model = nodes.Get(i)->GetObject<ConstantVelocityMobilityModel>();
+		NS_ASSERT_MSG(model, "SITL driven nodes need a ConstantVelocityMobilityModel");
+
+		int fd = socket(AF_INET, SOCK_DGRAM, 0);
+		if(fd < 0)
+		{
+			NS_FATAL_ERROR("Cannot create the MAVLink socket of node " << i);
+		}
+		sockaddr_in local;
+		memset(&local, 0, sizeof(local));
+		local.sin_family = AF_INET;
+		local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		local.sin_port = htons(basePort + i * portStride);
+		if(bind(fd, (sockaddr *) &local, sizeof(local)) < 0)
+		{
+			NS_FATAL_ERROR("Cannot bind the MAVLink socket of node " << i << " to port " << basePort + i * portStride);
+		}
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+		m_fds.push_back(fd);
+		m_models.push_back(model);
+	}
+}
+
+void MavlinkMobility::Start(double pollInterval, double jitterBound)
+{
+	m_pollInterval = Seconds(pollInterval);
+	m_jitterBound = Seconds(jitterBound);
+	m_pollEvent = Simulator::ScheduleNow(&MavlinkMobility::Poll, this);
+}
+
+void MavlinkMobility::Close()
+{
+	Simulator::Cancel(m_pollEvent);
+	for(uint32_t i = 0; i < m_fds.size(); i++)
+	{
+		close(m_fds[i]);
+	}
+	m_fds.clear();
+}
+
+void MavlinkMobility::PrintStats(std::ostream &os) const
+{
+	os << "---\n" << "SITL Nodes: " << m_fds.size() << "\nMAVLink Positions Applied: " << m_messages << "\nMAVLink Bad Frames: " << m_badFrames;
+	os << "\nAverage Lateness: " << (m_samples ? m_latenessSum * 1000 / m_samples : 0.0) << " ms" << "\nMaximum Lateness: " << m_latenessMax * 1000 << " ms";
+	os << "\nPolls Over Jitter Bound: " << m_lateSamples << " of " << m_samples << "\n---\n";
+}
+
+void MavlinkMobility::Poll()
+{
+	Ptr<RealtimeSimulatorImpl> realtime = DynamicCast<RealtimeSimulatorImpl>(Simulator::GetImplementation());
+	if(realtime)
+	{
+		double lateness = std::max((realtime->RealtimeNow() - Simulator::Now()).GetSeconds(), 0.0);
+		m_samples++;
+		m_latenessSum += lateness;
+		m_latenessMax = std::max(m_latenessMax, lateness);
+		m_lateSamples += (lateness > m_jitterBound.GetSeconds());
+	}
+
+	for(uint32_t i = 0; i < m_fds.size(); i++)
+	{
+		ssize_t length;
+		while((length = recv(m_fds[i], m_buffer, sizeof(m_buffer), MSG_DONTWAIT)) > 0)
+		{
+			HandleDatagram(i, m_buffer, length);
+		}
+	}
+
+	m_pollEvent = Simulator::Schedule(m_pollInterval, &MavlinkMobility::Poll, this);
+}
+
+//Walks the MAVLink v1 (0xFE) and v2 (0xFD) frames of a datagram in place
+void MavlinkMobility::HandleDatagram(uint32_t node, const uint8_t *data, uint32_t length)
+{
+	uint32_t offset = 0;
+	while(offset + 8 <= length)
+	{
+		const uint8_t *frame = data + offset;
+		uint32_t header;
+		uint32_t msgid;
+		uint32_t signature = 0;
+
+		if(frame[0] == 0xFE)
+		{
+			header = 6;
+			msgid = frame[5];
+		}
+		else if(frame[0] == 0xFD)
+		{
+			header = 10;
+			msgid = frame[7] | (uint32_t(frame[8]) << 8) | (uint32_t(frame[9]) << 16);
+			signature = (frame[2] & 0x01) ? 13 : 0;
+		}
+		else
+		{
+			offset++; //Resynchronise on the next start byte
+			continue;
+		}
+
+		uint32_t payloadLength = frame[1];
+		uint32_t frameLength = header + payloadLength + 2 + signature;
+		if(offset + frameLength > length)
+		{
+			m_badFrames++;
+			return;
+		}
+		offset += frameLength;
+
+		if(msgid != MAVLINK_MSG_GLOBAL_POSITION_INT || payloadLength > MAVLINK_GLOBAL_POSITION_INT_LEN)
+		{
+			continue;
+		}
+
+		uint8_t crcExtra = MAVLINK_CRC_EXTRA_GLOBAL_POSITION_INT;
+		uint16_t crc = MavlinkCrc(frame + 1, header - 1 + payloadLength, 0xffff);
+		crc = MavlinkCrc(&crcExtra, 1, crc);
+		if(crc != ReadLe16(frame + header + payloadLength))
+		{
+			m_badFrames++;
+			continue;
+		}
+
+		//MAVLink v2 trims the trailing zero bytes of the payload
+		uint8_t payload[MAVLINK_GLOBAL_POSITION_INT_LEN] = {0};
+		memcpy(payload, frame + header, payloadLength);
+		ApplyPosition(node, payload);
+	}
+}
+
+//GLOBAL_POSITION_INT: time_boot_ms | lat | lon (degE7) | alt | relative_alt (mm) | vx | vy | vz (cm/s, NED) | hdg
+//Positions are projected around the first fix (x east, y north, z up), which is good enough for a few km of flight
+void MavlinkMobility::ApplyPosition(uint32_t node, const uint8_t *payload)
+{
+	double lat = int32_t(ReadLe32(payload + 4)) * 1e-7;
+	double lon = int32_t(ReadLe32(payload + 8)) * 1e-7;
+	double relativeAlt = int32_t(ReadLe32(payload + 16)) * 1e-3;
+	double vx = int16_t(ReadLe16(payload + 20)) * 1e-2;
+	double vy = int16_t(ReadLe16(payload + 22)) * 1e-2;
+	double vz = int16_t(ReadLe16(payload + 24)) * 1e-2;
+
+	if(!m_haveOrigin)
+	{
+		m_haveOrigin = true;
+		m_originLat = lat;
+		m_originLon = lon;
+	}
+
+	const double earthRadius = 6378137.0;
+	const double degToRad = M_PI / 180.0;
+	double x = (lon - m_originLon) * degToRad * earthRadius * std::cos(m_originLat * degToRad);
+	double y = (lat - m_originLat) * degToRad * earthRadius;
+
+	m_models[node]->SetPosition(Vector(x, y, relativeAlt));
+	m_models[node]->SetVelocity(Vector(vy, vx, -vz));
+	m_messages++;
+}
+
+//-----------------------------------------------------------------------------
+//Connectivity analysis
+//Topology statistics that explain the protocol results: neighbour degree, link durations, partitions and hop counts over time.
+//Two nodes are linked while they are within the Friis range of the transmit power. Positions are sampled every interval, either live
+//from the MobilityModels or from a .mob trace (each trace line is a course change, positions in between are extrapolated from it).
+//Positions are kept as x/y/z arrays so the all-pairs distance loop vectorizes. Components come from a union-find built while the pairs
+//are scanned, and hop counts from a breadth-first search over adjacency bitsets, one word per 64 nodes.
+#define FRIIS_FREQUENCY 5.15e9 //Default of FriisPropagationLossModel, the channel uses it unchanged
+#define LINK_THRESHOLD -85.0 //Weakest received power counted as a link (dBm), about where the default phy still decodes 11 Mbps DSSS
+
+class ConnectivityAnalyzer
+{
+	public:
+		ConnectivityAnalyzer();
+		static double FriisRange(double txPower);
+		void Install(NodeContainer nodes, double range, double interval, std::string fileName);
+		void AnalyzeTrace(std::string traceName, double range, double interval, std::string fileName);
+		void PrintStats(std::ostream &os) const;
+
+	private:
+		void Open(uint32_t nodes, double range, std::string fileName);
+		void Sample();
+		void AddTimestep(double time);
+		uint32_t Find(uint32_t node);
+
+		uint32_t m_n; //Nodes
+		uint32_t m_words; //64 bit words per adjacency row
+		double m_range2; //Squared link range (m^2)
+		std::vector<double> m_x; //Positions of the current timestep
+		std::vector<double> m_y;
+		std::vector<double> m_z;
+		std::vector<double> m_d2; //Squared distances from one node to the following ones, reused for every row
+		std::vector<uint8_t> m_link; //Link state of every pair i < j, index i * n + j
+		std::vector<double> m_linkStart; //Time the link of every pair came up
+		std::vector<uint64_t> m_adjacency;
+		std::vector<uint64_t> m_visited;
+		std::vector<uint64_t> m_frontier;
+		std::vector<uint64_t> m_next;
+		std::vector<uint32_t> m_parent; //Union-find
+		std::vector<uint32_t> m_componentSize;
+		std::vector<uint32_t> m_degree;
+		std::vector<uint64_t> m_hopPairs; //Ordered node pairs seen at each hop count
+		std::vector<double> m_linkDurations; //Links that came up and went down again (seconds)
+		uint64_t m_timesteps;
+		uint64_t m_unreachablePairs;
+		uint64_t m_partitionEvents; //Timesteps where the number of components changed
+		uint32_t m_lastComponents;
+		double m_degreeSum;
+		std::ofstream m_out;
+		NodeContainer m_nodes;
+		Time m_interval;
+};
+
+ConnectivityAnalyzer::ConnectivityAnalyzer()
+{
+	m_n = 0;
+	m_words = 0;
+	m_range2 = 0;
+	m_timesteps = 0;
+	m_unreachablePairs = 0;
+	m_partitionEvents = 0;
+	m_lastComponents = 0;
+	m_degreeSum = 0;
+}
+
+//Distance where the Friis received power falls to LINK_THRESHOLD (unit antenna gains, no system loss)
+double ConnectivityAnalyzer::FriisRange(double txPower)
+{
+	double lambda = 299792458.0 / FRIIS_FREQUENCY;
+	return lambda / (4 * M_PI) * std::pow(10.0, (txPower - LINK_THRESHOLD) / 20);
+}
+
+void ConnectivityAnalyzer::Open(uint32_t nodes, double range, std::string fileName)
+{
+	m_n = nodes;
+	m_words = (nodes + 63) / 64;
+	m_range2 = range * range;
+	m_x.assign(nodes, 0.0);
+	m_y.assign(nodes, 0.0);
+	m_z.assign(nodes, 0.0);
+	m_d2.assign(nodes, 0.0);
+	m_link.assign(size_t(nodes) * nodes, 0);
+	m_linkStart.assign(size_t(nodes) * nodes, 0.0);
+	m_adjacency.assign(size_t(nodes) * m_words, 0);
+	m_visited.assign(m_words, 0);
+	m_frontier.assign(m_words, 0);
+	m_next.assign(m_words, 0);
+	m_parent.resize(nodes);
+	m_componentSize.resize(nodes);
+	m_degree.resize(nodes);
+	m_hopPairs.assign(nodes, 0);
+
+	m_out.open(fileName.c_str());
+	m_out << "Time,Links,AvgDegree,MinDegree,MaxDegree,Components,LargestComponent,ConnectedPairs,AvgHops,Diameter" << std::endl;
+}
+
+//Live: sample the MobilityModels of the nodes every interval
+void ConnectivityAnalyzer::Install(NodeContainer nodes, double range, double interval, std::string fileName)
+{
+	m_nodes = nodes;
+	m_interval = Seconds(interval);
+	Open(nodes.GetN(), range, fileName);
+	Simulator::ScheduleNow(&ConnectivityAnalyzer::Sample, this);
+}
+
+void ConnectivityAnalyzer::Sample()
+{
+	for(uint32_t i = 0; i < m_n; i++)
+	{
+		Vector position = m_nodes.Get(i)->GetObject<MobilityModel>()->GetPosition();
+		m_x[i] = position.x;
+		m_y[i] = position.y;
+		m_z[i] = position.z;
+	}
+	AddTimestep(Simulator::Now().GetSeconds());
+	Simulator::Schedule(m_interval, &ConnectivityAnalyzer::Sample, this);
+}
+
+//Offline: replay a MobilityHelper::EnableAsciiAll trace, lines look like "now=+500000000.0ns node=3 pos=x:y:z vel=x:y:z"
+void ConnectivityAnalyzer::AnalyzeTrace(std::string traceName, double range, double interval, std::string fileName)
+{
+	struct CourseChange
+	{
+		double time;
+		uint32_t node;
+		double position[3];
+		double velocity[3];
+	};
+	std::vector<CourseChange> changes;
+	uint32_t nodes = 0;
+
+	std::ifstream in(traceName.c_str());
+	if(!in)
+	{
+		NS_FATAL_ERROR("Cannot open mobility trace " << traceName);
+	}
+	std::string line;
+	while(std::getline(in, line))
+	{
+		CourseChange c;
+		double ns;
+		if(sscanf(line.c_str(), "now=%lfns node=%u pos=%lf:%lf:%lf vel=%lf:%lf:%lf", &ns, &c.node, &c.position[0], &c.position[1], &c.position[2],
+			&c.velocity[0], &c.velocity[1], &c.velocity[2]) != 8)
+		{
+			continue;
+		}
+		c.time = ns / 1e9;
+		changes.push_back(c);
+		nodes = std::max(nodes, c.node + 1);
+	}
+	Open(nodes, range, fileName);
+
+	//The latest course change of every node, extrapolated to each sample time
+	std::vector<CourseChange> last(nodes);
+	std::vector<bool> seen(nodes, false);
+	uint32_t seenNodes = 0;
+	double sampleTime = 0;
+	for(uint32_t k = 0; k <= changes.size(); k++)
+	{
+		double nextChange = k < changes.size() ? changes[k].time : changes.empty() ? 0 : changes.back().time + interval / 2;
+		while(seenNodes == nodes && sampleTime < nextChange)
+		{
+			for(uint32_t i = 0; i < nodes; i++)
+			{
+				double dt = sampleTime - last[i].time;
+				m_x[i] = last[i].position[0] + last[i].velocity[0] * dt;
+				m_y[i] = last[i].position[1] + last[i].velocity[1] * dt;
+				m_z[i] = last[i].position[2] + last[i].velocity[2] * dt;
+			}
+			AddTimestep(sampleTime);
+			sampleTime += interval;
+		}
+		if(k < changes.size())
+		{
+			uint32_t node = changes[k].node;
+			seenNodes += seen[node] ? 0 : 1;
+			seen[node] = true;
+			last[node] = changes[k];
+			if(seenNodes < nodes)
+			{
+				sampleTime = std::max(sampleTime, changes[k].time); //Start once every node has a position
+			}
+		}
+	}
+}
+
+uint32_t ConnectivityAnalyzer::Find(uint32_t node)
+{
+	while(m_parent[node] != node)
+	{
+		m_parent[node] = m_parent[m_parent[node]];
+		node = m_parent[node];
+	}
+	return node;
+}
+
+void ConnectivityAnalyzer::AddTimestep(double time)
+{
+	std::fill(m_adjacency.begin(), m_adjacency.end(), 0);
+	for(uint32_t i = 0; i < m_n; i++)
+	{
+		m_parent[i] = i;
+		m_componentSize[i] = 1;
+		m_degree[i] = 0;
+	}
+
+	//All pairs: distances of a whole row first (contiguous, vectorized), then the links, link durations and components
+	uint32_t links = 0;
+	for(uint32_t i = 0; i < m_n; i++)
+	{
+		const double xi = m_x[i];
+		const double yi = m_y[i];
+		const double zi = m_z[i];
+		const double *x = &m_x[0];
+		const double *y = &m_y[0];
+		const double *z = &m_z[0];
+		double *d2 = &m_d2[0];
+		for(uint32_t j = i + 1; j < m_n; j++)
+		{
+			double dx = x[j] - xi;
+			double dy = y[j] - yi;
+			double dz = z[j] - zi;
+			d2[j] = dx * dx + dy * dy + dz * dz;
+		}
+
+		for(uint32_t j = i + 1; j < m_n; j++)
+		{
+			size_t pair = size_t(i) * m_n + j;
+			uint8_t up = d2[j] <= m_range2;
+			if(up != m_link[pair])
+			{
+				if(up)
+				{
+					m_linkStart[pair] = time;
+				}
+				else
+				{
+					m_linkDurations.push_back(time - m_linkStart[pair]);
+				}
+				m_link[pair] = up;
+			}
+			if(!up)
+			{
+				continue;
+			}
+			links++;
+			m_degree[i]++;
+			m_degree[j]++;
+			m_adjacency[size_t(i) * m_words + j / 64] |= uint64_t(1) << (j % 64);
+			m_adjacency[size_t(j) * m_words + i / 64] |= uint64_t(1) << (i % 64);
+
+			uint32_t a = Find(i);
+			uint32_t b = Find(j);
+			if(a != b)
+			{
+				if(m_componentSize[a] < m_componentSize[b])
+				{
+					std::swap(a, b);
+				}
+				m_parent[b] = a;
+				m_componentSize[a] += m_componentSize[b];
+			}
+		}
+	}
+
+	uint32_t components = 0;
+	uint32_t largest = 0;
+	uint32_t minDegree = m_n ? m_degree[0] : 0;
+	uint32_t maxDegree = 0;
+	for(uint32_t i = 0; i < m_n; i++)
+	{
+		if(m_parent[i] == i)
+		{
+			components++;
+			largest = std::max(largest, m_componentSize[i]);
+		}
+		minDegree = std::min(minDegree, m_degree[i]);
+		maxDegree = std::max(maxDegree, m_degree[i]);
+	}
+	if(m_timesteps > 0 && components != m_lastComponents)
+	{
+		m_partitionEvents++;
+	}
+	m_lastComponents = components;
+
+	//Hop counts: breadth-first search from every node, one level is the OR of the adjacency rows of the frontier
+	uint64_t connectedPairs = 0;
+	uint64_t hopSum = 0;
+	uint32_t diameter = 0;
+	for(uint32_t source = 0; source < m_n; source++)
+	{
+		std::fill(m_visited.begin(), m_visited.end(), 0);
+		std::fill(m_frontier.begin(), m_frontier.end(), 0);
+		m_visited[source / 64] = m_frontier[source / 64] = uint64_t(1) << (source % 64);
+		for(uint32_t hops = 1; ; hops++)
+		{
+			std::fill(m_next.begin(), m_next.end(), 0);
+			for(uint32_t w = 0; w < m_words; w++)
+			{
+				for(uint64_t bits = m_frontier[w]; bits; bits &= bits - 1)
+				{
+					const uint64_t *row = &m_adjacency[size_t(w * 64 + __builtin_ctzll(bits)) * m_words];
+					for(uint32_t k = 0; k < m_words; k++)
+					{
+						m_next[k] |= row[k];
+					}
+				}
+			}
+			uint32_t reached = 0;
+			for(uint32_t w = 0; w < m_words; w++)
+			{
+				m_next[w] &= ~m_visited[w];
+				m_visited[w] |= m_next[w];
+				reached += __builtin_popcountll(m_next[w]);
+			}
+			if(reached == 0)
+			{
+				break;
+			}
+			m_hopPairs[hops] += reached;
+			connectedPairs += reached;
+			hopSum += uint64_t(hops) * reached;
+			diameter = std::max(diameter, hops);
+			m_frontier.swap(m_next);
+		}
+	}
+	uint64_t pairs = uint64_t(m_n) * (m_n > 0 ? m_n - 1 : 0);
+	m_unreachablePairs += pairs - connectedPairs;
+
+	double avgDegree = m_n ? 2.0 * links / m_n : 0.0;
+	m_degreeSum += avgDegree;
+	m_timesteps++;
+
+	m_out << time << "," << links << "," << avgDegree << "," << minDegree << "," << maxDegree << "," << components << "," << largest << ","
+		<< (pairs ? 100.0 * connectedPairs / pairs : 0.0) << "," << (connectedPairs ? double(hopSum) / connectedPairs : 0.0) << "," << diameter << std::endl;
+}
+
+void ConnectivityAnalyzer::PrintStats(std::ostream &os) const
+{
+	std::vector<double> durations(m_linkDurations);
+	std::sort(durations.begin(), durations.end());
+	double durationSum = 0;
+	for(uint32_t i = 0; i < durations.size(); i++)
+	{
+		durationSum += durations[i];
+	}
+	uint32_t linksUp = 0; //Links still up at the last timestep, their durations are cut off and left out
+	for(size_t i = 0; i < m_link.size(); i++)
+	{
+		linksUp += m_link[i];
+	}
+	uint64_t reachablePairs = 0;
+	for(uint32_t i = 0; i < m_hopPairs.size(); i++)
+	{
+		reachablePairs += m_hopPairs[i];
+	}
+
+	os << "---\n" << "Connectivity Timesteps: " << m_timesteps << "\nLink Range: " << std::sqrt(m_range2) << " m" << "\nAverage Degree: " << (m_timesteps ? m_degreeSum / m_timesteps : 0.0);
+	os << "\nLinks Broken: " << durations.size() << "\nAverage Link Duration: " << (durations.empty() ? 0.0 : durationSum / durations.size()) << " s";
+	os << "\nMedian Link Duration: " << (durations.empty() ? 0.0 : durations[durations.size() / 2]) << " s" << "\nLinks Up At End: " << linksUp;
+	os << "\nPartition Events: " << m_partitionEvents << "\nUnreachable Pairs: " << (reachablePairs + m_unreachablePairs ? 100.0 * m_unreachablePairs / (reachablePairs + m_unreachablePairs) : 0.0) << " %";
+	os << "\nHop Count Distribution:";
+	for(uint32_t hops = 1; hops < m_hopPairs.size(); hops++)
+	{
+		if(m_hopPairs[hops])
+		{
+			os << " " << hops << "=" << 100.0 * m_hopPairs[hops] / reachablePairs << "%";
+		}
+	}
+	os << "\n---\n";
+}
+
+//-----------------------------------------------------------------------------
+//Results database
+//Each run adds its configuration to "runs", one row per CSV interval to "intervals" and one row per FlowMonitor flow to "flows" of a
+//single SQLite file, so cross-run questions become one query, e.g. PDR vs nodes for all protocols:
+//  SELECT protocol, nodes, AVG(pdr) FROM runs WHERE experiment = 'routingProtocolsFANET' GROUP BY protocol, nodes;
+//The file is opened in WAL mode with a busy timeout so parallel sweep workers can share it. Intervals are buffered in memory and each
+//batch is written in one short BEGIN IMMEDIATE transaction, so the write lock is never held while the simulation runs.
+#define RESULTS_BATCH 30 //Intervals per transaction
+
+//One CSV interval
+struct IntervalRow
+{
+	double time;
+	double receiveKbps;
+	uint32_t packetsReceived;
+	uint32_t controlPackets;
+	uint32_t controlBytes;
+	uint32_t queuePackets;
+	double avgSojournMs;
+	double maxSojournMs;
+	uint64_t queueDrops;
+	uint32_t recordsReceived;
+	double avgRecordDelayMs;
+	uint32_t framesDone;
+	uint32_t framesHit;
+	uint32_t framesOffloaded;
+	double avgFrameLatencyMs;
+	uint64_t packetsCreated;
+	uint32_t queuedPackets;
+	uint64_t heapBytes;
+	uint64_t allocatedBytes;
+};
+
+class ResultsDatabase
+{
+	public:
+		ResultsDatabase();
+		~ResultsDatabase();
+		bool IsOpen() const;
+		void Open(std::string fileName);
+		void BeginRun(std::string experiment, std::string protocol, uint32_t nodes, uint32_t sinks, double txp, std::string config);
+		void AddInterval(const IntervalRow &row);
+		void AddFlows(Ptr<FlowMonitor> flowmon, Ptr<Ipv4FlowClassifier> classifier);
+		void EndRun(double pdr, bool controlCounted, uint64_t controlPackets, uint64_t controlBytes, double wallTime);
+		void Import(std::string fileName, bool replace);
+		void Close();
+
+	private:
+		void Execute(const char *sql);
+		sqlite3_stmt *Prepare(const char *sql);
+		void Step(sqlite3_stmt *statement);
+		void Flush();
+
+		sqlite3 *m_db;
+		sqlite3_stmt *m_insertInterval;
+		sqlite3_stmt *m_insertFlow;
+		int64_t m_runId;
+		std::vector<IntervalRow> m_pending; //Intervals not written yet
+};
+
+ResultsDatabase::ResultsDatabase()
+{
+	m_db = 0;
+	m_insertInterval = 0;
+	m_insertFlow = 0;
+	m_runId = -1;
+}
+
+ResultsDatabase::~ResultsDatabase()
+{
+	Close();
+}
+
+bool ResultsDatabase::IsOpen() const
+{
+	return m_db != 0;
+}
+
+void ResultsDatabase::Open(std::string fileName)
+{
+	if(sqlite3_open(fileName.c_str(), &m_db) != SQLITE_OK)
+	{
+		NS_FATAL_ERROR("Cannot open results database " << fileName << ": " << sqlite3_errmsg(m_db));
+	}
+	sqlite3_busy_timeout(m_db, 60000);
+	Execute("PRAGMA journal_mode=WAL");
+	Execute("PRAGMA synchronous=NORMAL");
+	Execute("CREATE TABLE IF NOT EXISTS runs (run_id INTEGER PRIMARY KEY, experiment TEXT, version TEXT, protocol TEXT, nodes INTEGER, sinks INTEGER, txp REAL, "
+		"seed INTEGER, run INTEGER, config TEXT, started TEXT DEFAULT CURRENT_TIMESTAMP, pdr REAL, control_packets INTEGER, control_bytes INTEGER, wall_time REAL)");
+	Execute("CREATE TABLE IF NOT EXISTS intervals (run_id INTEGER, time REAL, receive_kbps REAL, packets_received INTEGER, control_packets INTEGER, control_bytes INTEGER, "
+		"queue_packets INTEGER, avg_sojourn_ms REAL, max_sojourn_ms REAL, queue_drops INTEGER, records_received INTEGER, avg_record_delay_ms REAL, frames_done INTEGER, "
+		"frames_hit INTEGER, frames_offloaded INTEGER, avg_frame_latency_ms REAL, packets_created INTEGER, queued_packets INTEGER, heap_bytes INTEGER, allocated_bytes INTEGER, PRIMARY KEY (run_id, time)) WITHOUT ROWID");
+	Execute("CREATE TABLE IF NOT EXISTS flows (run_id INTEGER, flow_id INTEGER, source TEXT, destination TEXT, source_port INTEGER, destination_port INTEGER, ip_protocol INTEGER, "
+		"tx_packets INTEGER, rx_packets INTEGER, tx_bytes INTEGER, rx_bytes INTEGER, lost_packets INTEGER, delay_sum REAL, jitter_sum REAL, PRIMARY KEY (run_id, flow_id)) WITHOUT ROWID");
+	Execute("CREATE INDEX IF NOT EXISTS runs_by_config ON runs (experiment, protocol, nodes, pdr)");
+	Execute("CREATE INDEX IF NOT EXISTS flows_by_port ON flows (destination_port, run_id)");
+
+	m_insertInterval = Prepare("INSERT INTO intervals VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+	m_insertFlow = Prepare("INSERT INTO flows VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+}
+
+void ResultsDatabase::BeginRun(std::string experiment, std::string protocol, uint32_t nodes, uint32_t sinks, double txp, std::string config)
+{
+	std::ostringstream version;
+	version << VERSION;
+
+	sqlite3_stmt *insert = Prepare("INSERT INTO runs (experiment, version, protocol, nodes, sinks, txp, seed, run, config) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)");
+	sqlite3_bind_text(insert, 1, experiment.c_str(), -1, SQLITE_TRANSIENT);
+	sqlite3_bind_text(insert, 2, version.str().c_str(), -1, SQLITE_TRANSIENT);
+	sqlite3_bind_text(insert, 3, protocol.c_str(), -1, SQLITE_TRANSIENT);
+	sqlite3_bind_int(insert, 4, nodes);
+	sqlite3_bind_int(insert, 5, sinks);
+	sqlite3_bind_double(insert, 6, txp);
+	sqlite3_bind_int64(insert, 7, RngSeedManager::GetSeed());
+	sqlite3_bind_int64(insert, 8, RngSeedManager::GetRun());
+	sqlite3_bind_text(insert, 9, config.c_str(), -1, SQLITE_TRANSIENT);
+	Step(insert);
+	sqlite3_finalize(insert);
+
+	m_runId = sqlite3_last_insert_rowid(m_db);
+	m_pending.clear();
+	m_pending.reserve(RESULTS_BATCH);
+}
+
+void ResultsDatabase::AddInterval(const IntervalRow &row)
+{
+	m_pending.push_back(row);
+	if(m_pending.size() >= RESULTS_BATCH)
+	{
+		Flush();
+	}
+}
+
+//Writes the buffered intervals in one transaction, taking the write lock up front so a busy database is waited for before any insert
+void ResultsDatabase::Flush()
+{
+	if(m_pending.empty())
+	{
+		return;
+	}
+	Execute("BEGIN IMMEDIATE");
+	for(uint32_t i = 0; i < m_pending.size(); i++)
+	{
+		const IntervalRow &row = m_pending[i];
+		sqlite3_stmt *s = m_insertInterval;
+		sqlite3_bind_int64(s, 1, m_runId);
+		sqlite3_bind_double(s, 2, row.time);
+		sqlite3_bind_double(s, 3, row.receiveKbps);
+		sqlite3_bind_int64(s, 4, row.packetsReceived);
+		sqlite3_bind_int64(s, 5, row.controlPackets);
+		sqlite3_bind_int64(s, 6, row.controlBytes);
+		sqlite3_bind_int64(s, 7, row.queuePackets);
+		sqlite3_bind_double(s, 8, row.avgSojournMs);
+		sqlite3_bind_double(s, 9, row.maxSojournMs);
+		sqlite3_bind_int64(s, 10, row.queueDrops);
+		sqlite3_bind_int64(s, 11, row.recordsReceived);
+		sqlite3_bind_double(s, 12, row.avgRecordDelayMs);
+		sqlite3_bind_int64(s, 13, row.framesDone);
+		sqlite3_bind_int64(s, 14, row.framesHit);
+		sqlite3_bind_int64(s, 15, row.framesOffloaded);
+		sqlite3_bind_double(s, 16, row.avgFrameLatencyMs);
+		sqlite3_bind_int64(s, 17, row.packetsCreated);
+		sqlite3_bind_int64(s, 18, row.queuedPackets);
+		sqlite3_bind_int64(s, 19, row.heapBytes);
+		sqlite3_bind_int64(s, 20, row.allocatedBytes);
+		Step(s);
+	}
+	Execute("COMMIT");
+	m_pending.clear();
+}
+
+void ResultsDatabase::AddFlows(Ptr<FlowMonitor> flowmon, Ptr<Ipv4FlowClassifier> classifier)
+{
+	Flush();
+	std::map<FlowId, FlowMonitor::FlowStats> stats = flowmon->GetFlowStats();
+	Execute("BEGIN IMMEDIATE");
+	for(std::map<FlowId, FlowMonitor::FlowStats>::const_iterator it = stats.begin(); it != stats.end(); ++it)
+	{
+		Ipv4FlowClassifier::FiveTuple tuple = classifier->FindFlow(it->first);
+		std::ostringstream source, destination;
+		source << tuple.sourceAddress;
+		destination << tuple.destinationAddress;
+
+		sqlite3_stmt *s = m_insertFlow;
+		sqlite3_bind_int64(s, 1, m_runId);
+		sqlite3_bind_int64(s, 2, it->first);
+		sqlite3_bind_text(s, 3, source.str().c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_text(s, 4, destination.str().c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_int(s, 5, tuple.sourcePort);
+		sqlite3_bind_int(s, 6, tuple.destinationPort);
+		sqlite3_bind_int(s, 7, tuple.protocol);
+		sqlite3_bind_int64(s, 8, it->second.txPackets);
+		sqlite3_bind_int64(s, 9, it->second.rxPackets);
+		sqlite3_bind_int64(s, 10, it->second.txBytes);
+		sqlite3_bind_int64(s, 11, it->second.rxBytes);
+		sqlite3_bind_int64(s, 12, it->second.lostPackets);
+		sqlite3_bind_double(s, 13, it->second.delaySum.GetSeconds());
+		sqlite3_bind_double(s, 14, it->second.jitterSum.GetSeconds());
+		Step(s);
+	}
+	Execute("COMMIT");
+}
+
+//The control overhead columns stay NULL for protocols whose control traffic is not counted
+void ResultsDatabase::EndRun(double pdr, bool controlCounted, uint64_t controlPackets, uint64_t controlBytes, double wallTime)
+{
+	Flush();
+	sqlite3_stmt *update = Prepare("UPDATE runs SET pdr = ?, control_packets = ?, control_bytes = ?, wall_time = ? WHERE run_id = ?");
+	sqlite3_bind_double(update, 1, pdr);
+	if(controlCounted)
+	{
+		sqlite3_bind_int64(update, 2, controlPackets);
+		sqlite3_bind_int64(update, 3, controlBytes);
+	}
+	sqlite3_bind_double(update, 4, wallTime);
+	sqlite3_bind_int64(update, 5, m_runId);
+	Step(update);
+	sqlite3_finalize(update);
+}
+
+//Adds the finished run held in another results file (the per-run file of a run cache entry) under a new run_id. A finished run with the
+//same configuration already in this file is kept, or replaced when replace is set, so importing a cache entry twice adds the run once
+void ResultsDatabase::Import(std::string fileName, bool replace)
+{
+	sqlite3_stmt *attach = Prepare("ATTACH DATABASE ? AS cached");
+	sqlite3_bind_text(attach, 1, fileName.c_str(), -1, SQLITE_TRANSIENT);
+	Step(attach);
+	sqlite3_finalize(attach);
+
+	Execute("BEGIN IMMEDIATE");
+	sqlite3_stmt *source = Prepare("SELECT run_id FROM cached.runs WHERE pdr IS NOT NULL");
+	bool finished = sqlite3_step(source) == SQLITE_ROW;
+	std::ostringstream cachedId;
+	cachedId << (finished ? sqlite3_column_int64(source, 0) : -1);
+	sqlite3_finalize(source);
+
+	std::vector<int64_t> existing;
+	sqlite3_stmt *match = Prepare(("SELECT run_id FROM main.runs WHERE pdr IS NOT NULL AND config = (SELECT config FROM cached.runs WHERE run_id = " + cachedId.str() + ")").c_str());
+	while(sqlite3_step(match) == SQLITE_ROW)
+	{
+		existing.push_back(sqlite3_column_int64(match, 0));
+	}
+	sqlite3_finalize(match);
+
+	if(finished && (existing.empty() || replace))
+	{
+		for(uint32_t i = 0; i < existing.size(); i++)
+		{
+			std::ostringstream sql;
+			sql << "DELETE FROM main.runs WHERE run_id = " << existing[i] << "; DELETE FROM main.intervals WHERE run_id = " << existing[i] << "; DELETE FROM main.flows WHERE run_id = " << existing[i];
+			Execute(sql.str().c_str());
+		}
+		Execute(("INSERT INTO main.runs (experiment, version, protocol, nodes, sinks, txp, seed, run, config, started, pdr, control_packets, control_bytes, wall_time) "
+			"SELECT experiment, version, protocol, nodes, sinks, txp, seed, run, config, started, pdr, control_packets, control_bytes, wall_time FROM cached.runs WHERE run_id = " + cachedId.str()).c_str());
+		std::ostringstream runId;
+		runId << sqlite3_last_insert_rowid(m_db);
+		Execute(("INSERT INTO main.intervals SELECT " + runId.str() + ", time, receive_kbps, packets_received, control_packets, control_bytes, queue_packets, avg_sojourn_ms, "
+			"max_sojourn_ms, queue_drops, records_received, avg_record_delay_ms, frames_done, frames_hit, frames_offloaded, avg_frame_latency_ms, packets_created, queued_packets, "
+			"heap_bytes, allocated_bytes FROM cached.intervals WHERE run_id = " + cachedId.str()).c_str());
+		Execute(("INSERT INTO main.flows SELECT " + runId.str() + ", flow_id, source, destination, source_port, destination_port, ip_protocol, tx_packets, rx_packets, "
+			"tx_bytes, rx_bytes, lost_packets, delay_sum, jitter_sum FROM cached.flows WHERE run_id = " + cachedId.str()).c_str());
+	}
+	Execute("COMMIT");
+	Execute("DETACH DATABASE cached");
+}
+
+void ResultsDatabase::Close()
+{
+	if(!m_db)
+	{
+		return;
+	}
+	Flush();
+	sqlite3_finalize(m_insertInterval);
+	sqlite3_finalize(m_insertFlow);
+	sqlite3_close(m_db);
+	m_db = 0;
+	m_insertInterval = 0;
+	m_insertFlow = 0;
+}
+
+void ResultsDatabase::Execute(const char *sql)
+{
+	char *error = 0;
+	if(sqlite3_exec(m_db, sql, 0, 0, &error) != SQLITE_OK)
+	{
+		std::string message = error ? error : "unknown error";
+		sqlite3_free(error);
+		NS_FATAL_ERROR("Results database: " << message << " (" << sql << ")");
+	}
+}
+
+sqlite3_stmt *ResultsDatabase::Prepare(const char *sql)
+{
+	sqlite3_stmt *statement = 0;
+	if(sqlite3_prepare_v2(m_db, sql, -1, &statement, 0) != SQLITE_OK)
+	{
+		NS_FATAL_ERROR("Results database: " << sqlite3_errmsg(m_db) << " (" << sql << ")");
+	}
+	return statement;
+}
+
+//Runs a prepared statement and resets it for the next bind
+void ResultsDatabase::Step(sqlite3_stmt *statement)
+{
+	if(sqlite3_step(statement) != SQLITE_DONE)
+	{
+		NS_FATAL_ERROR("Results database: " << sqlite3_errmsg(m_db));
+	}
+	sqlite3_reset(statement);
+	sqlite3_clear_bindings(statement);
+}
+
+//-----------------------------------------------------------------------------
+//Live statistics
+//The counters of a running experiment are published in a memory-mapped file (e.g. under /dev/shm) that Scripts/livestats.py or a
+//sweep runner reads while the simulation runs. Publishing is plain memory writes and a CLOCK_MONOTONIC read, which Linux serves from the
+//vDSO, so the simulator makes no system call for it (SystemWallClockMs would call times()).
+//The header is rewritten every publish interval under a sequence counter that is odd while an update is in progress: a reader copies
+//the region and retries until it saw the same even sequence before and after the copy. The file is left in place when the run ends.
+#define LIVE_STATS_MAGIC 0x31534c54454e4146ULL //"FANETLS1"
+
+struct LiveStatsHeader
+{
+	uint64_t magic;
+	uint32_t sequence; //Odd while the header is being written
+	uint32_t pid; //Process of the run, for runners that stop runaway configurations
+	uint32_t nSinks;
+	uint32_t nDevices;
+	uint32_t finished; //1 once the simulation has stopped
+	uint32_t reserved;
+	double totalTime; //Simulated time of the run (seconds)
+	double simTime; //Simulated time reached (seconds)
+	double wallTime; //Wall time since the region was opened (seconds)
+	double eventsPerSecond; //Simulator events per wall clock second over the last publish interval
+	uint64_t events; //Simulator events executed
+	uint64_t controlPackets; //Routing control packets transmitted
+	uint64_t controlBytes; //Routing control bytes transmitted
+	//Followed by uint64_t sinkPackets[nSinks], uint64_t sinkBytes[nSinks] and uint32_t queueDepth[nDevices]
+};
+
+class LiveStats
+{
+	public:
+		LiveStats();
+		~LiveStats();
+		bool IsOpen() const;
+		void Open(std::string fileName, uint32_t nSinks, uint32_t nDevices, double totalTime);
+		void AddReceived(uint32_t sink, uint32_t bytes);
+		void SetQueueDepth(uint32_t device, uint32_t packets);
+		void Publish(uint64_t controlPackets, uint64_t controlBytes);
+		void Finish();
+		void Close();
+
+	private:
+		double WallTime() const;
+
+		LiveStatsHeader *m_header;
+		uint64_t *m_sinkPackets;
+		uint64_t *m_sinkBytes;
+		uint32_t *m_queueDepth;
+		size_t m_size;
+		struct timespec m_start; //Wall clock when the region was opened
+		double m_lastWallTime;
+		uint64_t m_lastEvents;
+};
+
+LiveStats::LiveStats()
+{
+	m_header = 0;
+	m_sinkPackets = 0;
+	m_sinkBytes = 0;
+	m_queueDepth = 0;
+	m_size = 0;
+	m_start.tv_sec = 0;
+	m_start.tv_nsec = 0;
+	m_lastWallTime = 0;
+	m_lastEvents = 0;
+}
+
+LiveStats::~LiveStats()
+{
+	Close();
+}
+
+bool LiveStats::IsOpen() const
+{
+	return m_header != 0;
+}
+
+void LiveStats::Open(std::string fileName, uint32_t nSinks, uint32_t nDevices, double totalTime)
+{
+	m_size = sizeof(LiveStatsHeader) + 2 * nSinks * sizeof(uint64_t) + nDevices * sizeof(uint32_t);
+	int fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0 || ftruncate(fd, m_size) != 0)
+	{
+		NS_FATAL_ERROR("Cannot create live statistics file " << fileName << ": " << strerror(errno));
+	}
+	void *region = mmap(0, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(region == MAP_FAILED)
+	{
+		NS_FATAL_ERROR("Cannot map live statistics file " << fileName << ": " << strerror(errno));
+	}
+
+	//ftruncate zero-fills the file, so every counter starts at 0
+	m_header = static_cast<LiveStatsHeader *>(region);
+	m_sinkPackets = reinterpret_cast<uint64_t *>(m_header + 1);
+	m_sinkBytes = m_sinkPackets + nSinks;
+	m_queueDepth = reinterpret_cast<uint32_t *>(m_sinkBytes + nSinks);
+	m_header->pid = getpid();
+	m_header->nSinks = nSinks;
+	m_header->nDevices = nDevices;
+	m_header->totalTime = totalTime;
+	__sync_synchronize();
+	m_header->magic = LIVE_STATS_MAGIC; //Written last, a reader ignores the region until the layout is filled in
+
+	clock_gettime(CLOCK_MONOTONIC, &m_start);
+	m_lastWallTime = 0;
+	m_lastEvents = 0;
+}
+
+//Called for every received data packet, the sink counters are updated in place
+void LiveStats::AddReceived(uint32_t sink, uint32_t bytes)
+{
+	if(m_header && sink < m_header->nSinks)
+	{
+		m_sinkPackets[sink]++;
+		m_sinkBytes[sink] += bytes;
+	}
+}
+
+void LiveStats::SetQueueDepth(uint32_t device, uint32_t packets)
+{
+	if(m_header && device < m_header->nDevices)
+	{
+		m_queueDepth[device] = packets;
+	}
+}
+
+void LiveStats::Publish(uint64_t controlPackets, uint64_t controlBytes)
+{
+	if(!m_header)
+	{
+		return;
+	}
+	double wallTime = WallTime();
+	uint64_t events = Simulator::GetEventCount();
+
+	m_header->sequence++;
+	__sync_synchronize();
+	m_header->simTime = Simulator::Now().GetSeconds();
+	m_header->wallTime = wallTime;
+	if(wallTime > m_lastWallTime)
+	{
+		m_header->eventsPerSecond = (events - m_lastEvents) / (wallTime - m_lastWallTime);
+		m_lastWallTime = wallTime;
+		m_lastEvents = events;
+	}
+	m_header->events = events;
+	m_header->controlPackets = controlPackets;
+	m_header->controlBytes = controlBytes;
+	__sync_synchronize();
+	m_header->sequence++;
+}
+
+void LiveStats::Finish()
+{
+	if(m_header)
+	{
+		m_header->finished = 1;
+	}
+}
+
+void LiveStats::Close()
+{
+	if(m_header)
+	{
+		munmap(m_header, m_size);
+		m_header = 0;
+	}
+}
+
+//Seconds since Open()
+double LiveStats::WallTime() const
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - m_start.tv_sec) + (now.tv_nsec - m_start.tv_nsec) * 1e-9;
+}
+
+//-----------------------------------------------------------------------------
+//Run cache
+//The key of a run is the FNV-1a hash of its effective configuration (every parameter that changes the results, the seed/run and VERSION).
+//A finished run copies its output files, summary and configuration to <cache>/<key>/. A later run with the same key copies them back
+//instead of simulating, so extending a sweep only simulates the new points. Bumping VERSION invalidates every entry.
+//Output files are stored under fixed entry names, so the output paths of a run (e.g. --CSVfileName) are not part of the key.
+typedef std::vector<std::pair<std::string, std::string> > CacheFiles; //Entry name and output path of every cached file
+
+class RunCache
+{
+	public:
+		RunCache();
+		void SetDirectory(std::string directory);
+		bool IsEnabled() const;
+		bool Lookup(std::string config);
+		bool Restore(const CacheFiles &files) const;
+		void Store(const CacheFiles &files, std::string summary) const;
+		std::string GetKey() const;
+		std::string GetSummary() const;
+
+	private:
+		static bool CopyFile(std::string from, std::string to);
+		static bool WriteFile(std::string path, std::string text);
+		static void RemoveEntry(std::string path, const CacheFiles &files);
+		std::string EntryPath(std::string name) const;
+
+		std::string m_directory;
+		std::string m_key;
+		std::string m_config;
+};
+
+RunCache::RunCache()
+{
+}
+
+void RunCache::SetDirectory(std::string directory)
+{
+	m_directory = directory;
+}
+
+bool RunCache::IsEnabled() const
+{
+	return !m_directory.empty();
+}
+
+//True when a complete entry exists for this configuration. The stored configuration is compared too, so a hash collision is a miss
+bool RunCache::Lookup(std::string config)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for(uint32_t i = 0; i < config.size(); i++)
+	{
+		hash = (hash ^ uint8_t(config[i])) * 1099511628211ULL;
+	}
+	std::ostringstream key;
+	key << std::hex << std::setw(16) << std::setfill('0') << hash;
+	m_key = key.str();
+	m_config = config;
+
+	std::ifstream stored(EntryPath("config.txt").c_str());
+	std::stringstream storedConfig;
+	storedConfig << stored.rdbuf();
+	return stored.good() && storedConfig.str() == config;
+}
+
+//Copies the outputs of the entry back. False when any of them is missing, which the caller treats as a miss. Every file is copied next
+//to its output first and renamed into place only once all copies succeeded, so a failed restore leaves the outputs untouched
+bool RunCache::Restore(const CacheFiles &files) const
+{
+	std::ostringstream suffix;
+	suffix << ".restore" << getpid();
+	bool complete = true;
+	for(uint32_t i = 0; i < files.size() && complete; i++)
+	{
+		complete = CopyFile(EntryPath(files[i].first), files[i].second + suffix.str());
+		if(!complete)
+		{
+			NS_LOG_WARN("Run cache: entry " << m_key << " has no " << files[i].first);
+		}
+	}
+	for(uint32_t i = 0; i < files.size(); i++)
+	{
+		std::string restored = files[i].second + suffix.str();
+		if(!complete || rename(restored.c_str(), files[i].second.c_str()) != 0)
+		{
+			remove(restored.c_str());
+		}
+	}
+	return complete;
+}
+
+//Written to a temporary directory and renamed, so parallel workers never see half an entry. Nothing is published if a copy fails
+void RunCache::Store(const CacheFiles &files, std::string summary) const
+{
+	std::ostringstream temporary;
+	temporary << m_directory << "/" << m_key << ".tmp" << getpid();
+	mkdir(m_directory.c_str(), 0755);
+	mkdir(temporary.str().c_str(), 0755);
+
+	bool complete = true;
+	for(uint32_t i = 0; i < files.size() && complete; i++)
+	{
+		complete = CopyFile(files[i].second, temporary.str() + "/" + files[i].first);
+	}
+	complete = complete && WriteFile(temporary.str() + "/summary.txt", summary);
+	complete = complete && WriteFile(temporary.str() + "/config.txt", m_config);
+	if(!complete)
+	{
+		NS_LOG_WARN("Run cache: entry " << m_key << " was not stored, an output could not be copied");
+		RemoveEntry(temporary.str(), files);
+		return;
+	}
+
+	//A rerun replaces the old entry, which is moved aside first because rename() does not overwrite a non-empty directory.
+	//If the new entry cannot be renamed into place the old one is put back
+	std::string entry = m_directory + "/" + m_key;
+	std::string stale = temporary.str() + ".stale";
+	bool replaced = rename(entry.c_str(), stale.c_str()) == 0;
+	if(rename(temporary.str().c_str(), entry.c_str()) != 0)
+	{
+		NS_LOG_WARN("Run cache: entry " << m_key << " was not stored (another worker may have stored it first)");
+		RemoveEntry(temporary.str(), files);
+		if(replaced && rename(stale.c_str(), entry.c_str()) == 0)
+		{
+			replaced = false;
+		}
+	}
+	if(replaced)
+	{
+		RemoveEntry(stale, files);
+	}
+}
+
+std::string RunCache::GetKey() const
+{
+	return m_key;
+}
+
+std::string RunCache::GetSummary() const
+{
+	std::ifstream in(EntryPath("summary.txt").c_str());
+	std::stringstream summary;
+	summary << in.rdbuf();
+	return summary.str();
+}
+
+bool RunCache::CopyFile(std::string from, std::string to)
+{
+	std::ifstream in(from.c_str(), std::ios::binary);
+	if(!in)
+	{
+		return false;
+	}
+	std::ofstream out(to.c_str(), std::ios::binary);
+	out << in.rdbuf();
+	out.close();
+	return !out.fail();
+}
+
+bool RunCache::WriteFile(std::string path, std::string text)
+{
+	std::ofstream out(path.c_str());
+	out << text;
+	out.close();
+	return !out.fail();
+}
+
+//Deletes an entry directory with the files Store() writes to it
+void RunCache::RemoveEntry(std::string path, const CacheFiles &files)
+{
+	for(uint32_t i = 0; i < files.size(); i++)
+	{
+		remove((path + "/" + files[i].first).c_str());
+	}
+	remove((path + "/summary.txt").c_str());
+	remove((path + "/config.txt").c_str());
+	rmdir(path.c_str());
+}
+
+std::string RunCache::EntryPath(std::string name) const
+{
+	return m_directory + "/" + m_key + "/" + name;
+}
+
+//-----------------------------------------------------------------------------
+//Typed scenario setup
+//The routing protocol and the mobility model are template parameters of RoutingExperiment::BuildScenario, which constructs the agents,
+//mobility models and random variables directly instead of resolving "ns3::..." type names and parsing attribute strings for every node.
+//A policy that does not exist, or lacks a member the builder uses, is a compile error. Run maps --protocol and --sitl to one instantiation.
+static Ptr<UniformRandomVariable> UniformVariable(double min, double max)
+{
+	Ptr<UniformRandomVariable> variable = CreateObject<UniformRandomVariable>();
+	variable->SetAttribute("Min", DoubleValue(min));
+	variable->SetAttribute("Max", DoubleValue(max));
+	return variable;
+}
+
+static Ptr<NormalRandomVariable> NormalVariable(double mean, double variance, double bound)
+{
+	Ptr<NormalRandomVariable> variable = CreateObject<NormalRandomVariable>();
+	variable->SetAttribute("Mean", DoubleValue(mean));
+	variable->SetAttribute("Variance", DoubleValue(variance));
+	variable->SetAttribute("Bound", DoubleValue(bound));
+	return variable;
+}
+
+//Ipv4RoutingHelper that creates the agent class itself, the same as AodvHelper, OlsrHelper and DsdvHelper do through their factories
+template <class Agent>
+class AgentRoutingHelper : public Ipv4RoutingHelper
+{
+	public:
+		AgentRoutingHelper *Copy() const
+		{
+			return new AgentRoutingHelper<Agent>(*this);
+		}
+
+		Ptr<Ipv4RoutingProtocol> Create(Ptr<Node> node) const
+		{
+			Ptr<Agent> agent = CreateObject<Agent>();
+			node->AggregateObject(agent);
+			return agent;
+		}
+};
+
+template <class Agent>
+static void InstallListRouting(NodeContainer nodes)
+{
+	AgentRoutingHelper<Agent> agent;
+	Ipv4ListRoutingHelper list;
+	list.Add(agent, 100);
+	InternetStackHelper internet;
+	internet.SetRoutingHelper(list);
+	internet.Install(nodes);
+}
+
+//Routing policies: Name() is written to the results, Install() builds the internet stack and Start() runs once the addresses are assigned
+struct OlsrProtocol
+{
+	static const char *Name() { return "OLSR"; }
+	static void Install(NodeContainer nodes, ClusterManager &) { InstallListRouting<olsr::RoutingProtocol>(nodes); }
+	static void Start(NodeContainer, Ipv4InterfaceContainer, ClusterManager &, double, uint32_t) {}
+};
+
+struct AodvProtocol
+{
+	static const char *Name() { return "AODV"; }
+	static void Install(NodeContainer nodes, ClusterManager &) { InstallListRouting<aodv::RoutingProtocol>(nodes); }
+	static void Start(NodeContainer, Ipv4InterfaceContainer, ClusterManager &, double, uint32_t) {}
+};
+
+struct DsdvProtocol
+{
+	static const char *Name() { return "DSDV"; }
+	static void Install(NodeContainer nodes, ClusterManager &) { InstallListRouting<dsdv::RoutingProtocol>(nodes); }
+	static void Start(NodeContainer, Ipv4InterfaceContainer, ClusterManager &, double, uint32_t) {}
+};
+
+//DSR is not an Ipv4RoutingProtocol, DsrMainHelper wires it below the IP layer of every node
+struct DsrProtocol
+{
+	static const char *Name() { return "DSR"; }
+	static void Install(NodeContainer nodes, ClusterManager &)
+	{
+		InternetStackHelper internet;
+		internet.Install(nodes);
+		DsrHelper dsr;
+		DsrMainHelper dsrMain;
+		dsrMain.Install(dsr, nodes);
+	}
+	static void Start(NodeContainer, Ipv4InterfaceContainer, ClusterManager &, double, uint32_t) {}
+};
+
+struct ClusterProtocol
+{
+	static const char *Name() { return "CLUSTER"; }
+	static void Install(NodeContainer nodes, ClusterManager &cluster)
+	{
+		ClusterRoutingHelper routing(&cluster);
+		Ipv4ListRoutingHelper list;
+		list.Add(routing, 100);
+		InternetStackHelper internet;
+		internet.SetRoutingHelper(list);
+		internet.Install(nodes);
+	}
+	static void Start(NodeContainer nodes, Ipv4InterfaceContainer interfaces, ClusterManager &cluster, double period, uint32_t metric)
+	{
+		cluster.Install(nodes, interfaces);
+		cluster.Start(period, metric);
+	}
+};
+
+//Mobility policies: Prepare() runs once before the models are created, Model is created for every node and Configure() sets it up
+struct ConstantVelocityMobility
+{
+	typedef ConstantVelocityMobilityModel Model;
+	void Prepare() const {}
+	void Configure(Ptr<Model>) const {}
+};
+
+struct GaussMarkovParameters
+{
+	Box bounds;
+	double timeStep; //Seconds
+	double alpha; //Memory of the previous velocity, 0 is random walk and 1 is constant velocity
+	double meanVelocityMin; //m/s
+	double meanVelocityMax;
+	double meanDirectionMin; //rad
+	double meanDirectionMax;
+	double meanPitchMin; //rad
+	double meanPitchMax;
+	double normalVelocityVariance; //Gaussian noise, mean 0
+	double normalVelocityBound;
+	double normalDirectionVariance;
+	double normalDirectionBound;
+	double normalPitchVariance;
+	double normalPitchBound;
+};
+
+//Every model gets its own random variables, like the attribute strings MobilityHelper used to parse for each node.
+//The shared parameters become attribute defaults once per run. The random variable attributes default to StringValue type names, which
+//would be parsed into a new variable for every model only to be replaced, so their defaults are set to one placeholder variable instead
+class GaussMarkovMobility
+{
+	public:
+		typedef GaussMarkovMobilityModel Model;
+		GaussMarkovMobility(const GaussMarkovParameters &parameters);
+		void Prepare() const;
+		void Configure(Ptr<Model> model) const;
+		void Print(std::ostream &os) const;
+
+	private:
+		GaussMarkovParameters m_parameters;
+};
+
+GaussMarkovMobility::GaussMarkovMobility(const GaussMarkovParameters &parameters)
+{
+	m_parameters = parameters;
+}
+
+void GaussMarkovMobility::Prepare() const
+{
+	Config::SetDefault("ns3::GaussMarkovMobilityModel::Bounds", BoxValue(m_parameters.bounds));
+	Config::SetDefault("ns3::GaussMarkovMobilityModel::TimeStep", TimeValue(Seconds(m_parameters.timeStep)));
+	Config::SetDefault("ns3::GaussMarkovMobilityModel::Alpha", DoubleValue(m_parameters.alpha));
+	PointerValue placeholder(CreateObject<ConstantRandomVariable>());
+	Config::SetDefault("ns3::GaussMarkovMobilityModel::MeanVelocity", placeholder);
+	Config::SetDefault("ns3::GaussMarkovMobilityModel::MeanDirection", placeholder);
+	Config::SetDefault("ns3::GaussMarkovMobilityModel::MeanPitch", placeholder);
+	Config::SetDefault("ns3::GaussMarkovMobilityModel::NormalVelocity", placeholder);
+	Config::SetDefault("ns3::GaussMarkovMobilityModel::NormalDirection", placeholder);
+	Config::SetDefault("ns3::GaussMarkovMobilityModel::NormalPitch", placeholder);
+}
+
+void GaussMarkovMobility::Configure(Ptr<Model> model) const
+{
+	model->SetAttribute("MeanVelocity", PointerValue(UniformVariable(m_parameters.meanVelocityMin, m_parameters.meanVelocityMax)));
+	model->SetAttribute("MeanDirection", PointerValue(UniformVariable(m_parameters.meanDirectionMin, m_parameters.meanDirectionMax)));
+	model->SetAttribute("MeanPitch", PointerValue(UniformVariable(m_parameters.meanPitchMin, m_parameters.meanPitchMax)));
+	model->SetAttribute("NormalVelocity", PointerValue(NormalVariable(0.0, m_parameters.normalVelocityVariance, m_parameters.normalVelocityBound)));
+	model->SetAttribute("NormalDirection", PointerValue(NormalVariable(0.0, m_parameters.normalDirectionVariance, m_parameters.normalDirectionBound)));
+	model->SetAttribute("NormalPitch", PointerValue(NormalVariable(0.0, m_parameters.normalPitchVariance, m_parameters.normalPitchBound)));
+}
+
+//Part of the run cache key
+void GaussMarkovMobility::Print(std::ostream &os) const
+{
+	const GaussMarkovParameters &p = m_parameters;
+	os << "gaussMarkov=" << p.bounds.xMin << "," << p.bounds.xMax << "," << p.bounds.yMin << "," << p.bounds.yMax << "," << p.bounds.zMin << "," << p.bounds.zMax;
+	os << "," << p.timeStep << "," << p.alpha << "," << p.meanVelocityMin << "," << p.meanVelocityMax << "," << p.meanDirectionMin << "," << p.meanDirectionMax;
+	os << "," << p.meanPitchMin << "," << p.meanPitchMax << "," << p.normalVelocityVariance << "," << p.normalVelocityBound << "," << p.normalDirectionVariance;
+	os << "," << p.normalDirectionBound << "," << p.normalPitchVariance << "," << p.normalPitchBound;
+}
+
 class RoutingExperiment
 {
 	public:
@@ -56,15 +2870,56 @@ class RoutingExperiment
 		//static void SetMACParam (ns3::NetDeviceContainer & devices,
 		//                                 int slotDistance);
 		std::string CommandSetup(int argc, char **argv);
+		void StoreCachedRun();
+		bool AnalyzeTrace(double txp);
 
 	private:
 		Ptr<Socket> SetupPacketReceive(Ipv4Address addr, Ptr<Node> node);
 		void ReceivePacket(Ptr<Socket> socket);
 		void CheckThroughput();
+		void CountControlPacket(Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface);
+		bool ControlCounted() const;
+		void QueueSojourn(Time sojourn);
+		void FrameDone(Time latency, bool offloaded, bool deadlineMet);
+		void InstallQueueDiscs(NetDeviceContainer devices);
+		template <class Mobility>
+		Ipv4InterfaceContainer SelectProtocol(NodeContainer nodes, NetDeviceContainer devices, const Mobility &mobility, Ptr<PositionAllocator> positions);
+		template <class Protocol, class Mobility>
+		Ipv4InterfaceContainer BuildScenario(NodeContainer nodes, NetDeviceContainer devices, const Mobility &mobility, Ptr<PositionAllocator> positions);
+		void PublishLiveStats();
+		double PrintSummary(std::ostream &os, Ptr<FlowMonitor> flowmon, FlowMonitorHelper &flowmonHelper);
 
 		uint32_t port;
 		uint32_t bytesTotal; //Bytes received counter
 		uint32_t packetsReceived; //Packets received coutner
+		uint32_t controlPackets; //Routing control packets transmitted counter
+		uint32_t controlBytes; //Routing control bytes transmitted counter
+		uint64_t totalControlPackets; //Routing control packets transmitted during the whole run
+		uint64_t totalControlBytes; //Routing control bytes transmitted during the whole run
+		std::set<std::pair<uint32_t, uint64_t> > m_controlFragments; //(node, source address and IP identification) of control datagrams being fragmented
+		uint32_t dequeuedPackets; //Packets dequeued from the queue discs counter
+		Time sojournTotal; //Sum of the queue sojourn times of the dequeued packets
+		Time sojournMax; //Largest queue sojourn time of the interval
+		uint64_t queueDrops; //Queue disc drops of all the devices up to the previous interval
+		uint32_t recordsReceived; //Telemetry records received counter
+		uint64_t totalRecordsReceived; //Telemetry records received during the whole run
+		Time recordDelaySum; //Sum of the sample-to-ground delays of the received records
+		std::vector<uint8_t> m_decodeBuffer; //Reused by the telemetry decoder
+		uint64_t lastPacketUid; //Packet uid counter at the previous interval
+		uint64_t totalPacketsCreated; //Packets created during the whole run, the probe packets left out
+		uint64_t firstHeapBytes; //Heap in use at the first interval
+		uint64_t lastHeapBytes; //Heap in use at the latest interval
+		uint64_t lastAllocatedBytes; //Allocation counter at the previous interval
+		uint64_t firstAllocatedBytes; //Allocation counter at the first interval
+		std::vector<Ptr<WifiMacQueue> > m_macQueues; //MAC queue of every ad-hoc device
+		uint32_t framesDone; //Pipeline frames finished (on time or late) counter
+		uint32_t framesHit; //Pipeline frames that met their deadline counter
+		uint32_t framesOffloaded; //Pipeline frames processed by a ground station counter
+		Time frameLatencySum; //Sum of the pipeline frame latencies
+		uint64_t totalFramesDone; //Pipeline frames finished (on time or late) during the whole run
+		uint64_t totalFramesHit; //Pipeline frames that met their deadline during the whole run
+		uint64_t totalFramesOffloaded; //Pipeline frames processed by a ground station during the whole run
+		Time totalFrameLatency; //Sum of the pipeline frame latencies of the whole run
 
 		std::string m_CSVfileName; //Output filename
 		int m_nSinks; //Number of receivers
@@ -72,17 +2927,121 @@ class RoutingExperiment
 		double m_txp; //Transmit power (dBm)
 		bool m_traceMobility; //Enable-Disable mobility tracing
 		uint32_t m_protocol; //Routing protocol selector (number)
+		bool m_tracePackets; //Enable packet metadata (printing) for tracing
+		uint32_t m_nWifis; //Number of nodes in the simulation
+		uint32_t m_clusterMetric; //Cluster head election metric selector (number)
+		double m_clusterPeriod; //Cluster beacon and election period (seconds)
+		ClusterManager m_cluster; //Cluster heads and routes for protocol 5
+		uint32_t m_queueDisc; //Queue disc selector (number)
+		uint32_t m_telemetrySinks; //Number of sink pairs carrying telemetry (prioritised) traffic
+		std::string m_macQueueSize; //Wifi MAC queue size when a queue disc is selected
+		QueueDiscContainer m_qdiscs; //Root queue disc of every ad-hoc device
+		bool m_aggregation; //Replace the OnOff sources with telemetry aggregation
+		double m_aggregationWindow; //Time a batch collects records before it is sent (seconds)
+		uint32_t m_recordSize; //Telemetry record size (bytes)
+		double m_recordRate; //Telemetry records sampled per second by each UAV
+		uint32_t m_offloadPolicy; //Edge offload pipeline selector (number)
+		uint32_t m_frameSize; //Sensor frame size (bytes)
+		double m_frameRate; //Sensor frames per second of each offloading UAV
+		double m_frameDeadline; //Time a frame has to be processed (seconds)
+		double m_uavProcessingRate; //UAV CPU speed (bytes/s)
+		double m_groundProcessingRate; //Ground station CPU speed (bytes/s)
+		std::vector<Ptr<EdgeOffloadClient> > m_offloadClients; //Pipeline of every offloading UAV
+		bool m_sitl; //Drive the nodes from ArduPilot SITL instances in real time
+		uint32_t m_sitlInstances; //Number of nodes driven by SITL, starting from node 0
+		uint32_t m_sitlBasePort; //MAVLink UDP port of node 0
+		uint32_t m_sitlPortStride; //MAVLink UDP port step between nodes
+		double m_sitlPoll; //MAVLink poll interval (seconds)
+		double m_sitlJitter; //Allowed lateness behind the wall clock (seconds)
+		bool m_sitlHardLimit; //Abort the run when the lateness exceeds the jitter bound
+		MavlinkMobility m_mavlink; //MAVLink position receiver
+		std::string m_resultsDb; //SQLite results file, empty to disable
+		std::string m_config; //Effective configuration of this run, the run cache key and the config stored with the results
+		ResultsDatabase m_results;
+		std::string m_runCache; //Run cache directory, empty to disable
+		bool m_rerun; //Simulate even when the run cache has this configuration
+		RunCache m_cache;
+		bool m_cacheHit; //This run was served from the run cache
+		CacheFiles m_outputFiles; //Files a run produces, stored in the run cache
+		std::string m_summary; //Summary printed at the end of the run
+		std::string m_liveStatsFile; //Memory-mapped live statistics file, empty to disable
+		double m_liveStatsInterval; //Live statistics publish interval (simulated seconds)
+		LiveStats m_liveStats;
+		bool m_connectivity; //Sample the topology statistics during the run
+		double m_connectivityInterval; //Topology sample interval (seconds)
+		std::string m_analyzeMob; //Mobility trace to analyze instead of simulating, empty to simulate
+		ConnectivityAnalyzer m_analyzer;
 };
 
+//Wall time, simulator event rate and peak memory of the run, parsed by Scripts/benchmark.sh. Setup Time covers Run() up to the
+//simulation (scenario, stack, applications and traces), Wall Time and Events Per Second cover Simulator::Run only
+static void PrintRunPerformance(int64_t setupMs, int64_t wallMs)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	uint64_t events = Simulator::GetEventCount();
+
+	std::cout << "---\n" << "Setup Time: " << setupMs / 1000.0 << " s" << "\nWall Time: " << wallMs / 1000.0 << " s" << "\nSimulator Events: " << events << "\nEvents Per Second: " << (wallMs > 0 ? events * 1000.0 / wallMs : 0.0) << "\nPeak RSS: " << usage.ru_maxrss << " kB" << "\n---\n";
+}
+
 //Constuctor with default values. those can be overwritten with cmd arguments
 RoutingExperiment::RoutingExperiment()
 {
 	port = 9;                                     //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
 	bytesTotal = 0;                               //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
 	packetsReceived = 0;                          //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	controlPackets = 0;
+	controlBytes = 0;
+	totalControlPackets = 0;
+	totalControlBytes = 0;
+	dequeuedPackets = 0;
+	queueDrops = 0;
+	recordsReceived = 0;
+	totalRecordsReceived = 0;
+	lastPacketUid = 0;
+	totalPacketsCreated = 0;
+	firstHeapBytes = 0;
+	lastHeapBytes = 0;
+	lastAllocatedBytes = 0;
+	firstAllocatedBytes = 0;
+	framesDone = 0;
+	framesHit = 0;
+	framesOffloaded = 0;
+	totalFramesDone = 0;
+	totalFramesHit = 0;
+	totalFramesOffloaded = 0;
 	m_CSVfileName = "routingProtocolsFANET.csv";  //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
 	m_traceMobility = false;                      //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
 	m_protocol = 2; // AODV                       //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_tracePackets = false;                       //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_nWifis = 10;                                //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_clusterMetric = 1; // Connectivity          //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_clusterPeriod = 1.0;                        //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_queueDisc = 0; // Default (pfifo_fast)      //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_telemetrySinks = 0;                         //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_macQueueSize = "32p";                       //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_aggregation = false;                        //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_aggregationWindow = 0.1;                    //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_recordSize = 64;                            //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_recordRate = 20.0;                          //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_offloadPolicy = 0; // Off                   //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_frameSize = 20000;                          //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_frameRate = 10.0;                           //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_frameDeadline = 0.2;                        //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_uavProcessingRate = 200000.0;               //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_groundProcessingRate = 2000000.0;           //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_sitl = false;                               //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_sitlInstances = 1;                          //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_sitlBasePort = 14550;                       //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_sitlPortStride = 10;                        //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_sitlPoll = 0.02;                            //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_sitlJitter = 0.05;                          //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_sitlHardLimit = false;                      //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_rerun = false;                              //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_liveStatsInterval = 0.1;                    //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_connectivity = false;                       //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_connectivityInterval = 0.5;                 //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_cacheHit = false;
 }
 
 //Print when each packet is received, on which port and from which sender
@@ -114,6 +3073,11 @@ void RoutingExperiment::ReceivePacket(Ptr<Socket> socket) //Count how packets ar
 	{
 		bytesTotal += packet->GetSize();
 		packetsReceived += 1;
+		m_liveStats.AddReceived(socket->GetNode()->GetId(), packet->GetSize()); //Sink i is node i
+		if(m_aggregation)
+		{
+			recordsReceived += TelemetryAggregator::Decode(packet, m_recordSize, recordDelaySum, m_decodeBuffer);
+		}
 		NS_LOG_UNCOND(PrintReceivedPacket(socket, packet, senderAddress));
 	}
 }
@@ -125,19 +3089,83 @@ void RoutingExperiment::CheckThroughput()
 	double kbs = (bytesTotal * 8.0) / 1000;
 	bytesTotal = 0;
 
+	uint32_t queuePackets = 0; //Packets waiting in the queue discs right now
+	uint64_t drops = 0;
+	for(uint32_t i = 0; i < m_qdiscs.GetN(); i++)
+	{
+		queuePackets += m_qdiscs.Get(i)->GetNPackets();
+		drops += m_qdiscs.Get(i)->GetStats().nTotalDroppedPackets;
+	}
+	double avgSojourn = dequeuedPackets ? sojournTotal.GetSeconds() * 1000 / dequeuedPackets : 0.0;
+	double avgRecordDelay = recordsReceived ? recordDelaySum.GetSeconds() * 1000 / recordsReceived : 0.0;
+	double avgFrameLatency = framesDone ? frameLatencySum.GetSeconds() * 1000 / framesDone : 0.0;
+
+	//Memory: packets created and bytes allocated since the last interval (every packet takes a new uid), packets held in the queue discs
+	//and MAC queues, and heap in use
+	uint64_t packetUid = Create<Packet>()->GetUid();
+	uint64_t packetsCreated = packetUid - lastPacketUid - (lastPacketUid ? 1 : 0); //Leave out the probe packet of the previous interval
+	lastPacketUid = packetUid;
+	totalPacketsCreated += packetsCreated;
+	uint32_t queuedPackets = queuePackets;
+	for(uint32_t i = 0; i < m_macQueues.size(); i++)
+	{
+		queuedPackets += m_macQueues[i]->GetNPackets();
+	}
+	uint64_t allocated = g_allocatedBytes;
+	uint64_t allocatedBytes = lastAllocatedBytes ? allocated - lastAllocatedBytes : 0;
+	if(firstAllocatedBytes == 0)
+	{
+		firstAllocatedBytes = allocated;
+	}
+	lastAllocatedBytes = allocated;
+#if defined(__GLIBC_PREREQ) && __GLIBC_PREREQ(2, 33)
+	struct mallinfo2 heap = mallinfo2(); //mallinfo() is deprecated since glibc 2.33
+	lastHeapBytes = uint64_t(heap.uordblks) + uint64_t(heap.hblkhd);
+#else
+	struct mallinfo heap = mallinfo();
+	lastHeapBytes = uint32_t(heap.uordblks) + uint64_t(uint32_t(heap.hblkhd)); //mallinfo fields are int, read them as unsigned to get up to 4 GB each
+#endif
+	if(firstHeapBytes == 0)
+	{
+		firstHeapBytes = lastHeapBytes;
+	}
+
 	std::ofstream out(m_CSVfileName.c_str(), std::ios::app);
 
-	out << (Simulator::Now()).GetSeconds() << "," << kbs << "," << packetsReceived << "," << m_nSinks << "," << m_protocolName << "," << m_txp << "" << std::endl;
+	if(m_results.IsOpen())
+	{
+		IntervalRow row = {Simulator::Now().GetSeconds(), kbs, packetsReceived, controlPackets, controlBytes, queuePackets, avgSojourn, sojournMax.GetSeconds() * 1000, drops - queueDrops,
+			recordsReceived, avgRecordDelay, framesDone, framesHit, framesOffloaded, avgFrameLatency, packetsCreated, queuedPackets, lastHeapBytes, allocatedBytes};
+		m_results.AddInterval(row);
+	}
+
+	out << (Simulator::Now()).GetSeconds() << "," << kbs << "," << packetsReceived << "," << m_nSinks << "," << m_protocolName << "," << m_txp << "," << m_nWifis << "," << controlPackets << "," << controlBytes << "," << queuePackets << "," << avgSojourn << "," << sojournMax.GetSeconds() * 1000 << "," << drops - queueDrops << "," << recordsReceived << "," << avgRecordDelay << "," << framesDone << "," << framesHit << "," << framesOffloaded << "," << avgFrameLatency << "," << packetsCreated << "," << queuedPackets << "," << lastHeapBytes << "," << allocatedBytes << std::endl;
 
 	out.close();
 	packetsReceived = 0;
+	controlPackets = 0;
+	controlBytes = 0;
+	dequeuedPackets = 0;
+	sojournTotal = Seconds(0);
+	sojournMax = Seconds(0);
+	queueDrops = drops;
+	totalRecordsReceived += recordsReceived;
+	recordsReceived = 0;
+	recordDelaySum = Seconds(0);
+	totalFramesDone += framesDone;
+	totalFramesHit += framesHit;
+	totalFramesOffloaded += framesOffloaded;
+	totalFrameLatency += frameLatencySum;
+	framesDone = 0;
+	framesHit = 0;
+	framesOffloaded = 0;
+	frameLatencySum = Seconds(0);
 	Simulator::Schedule(Seconds(intervalTime), &RoutingExperiment::CheckThroughput, this); //Schedule to run this function every X seconds
 }
 
 Ptr<Socket> RoutingExperiment::SetupPacketReceive(Ipv4Address addr, Ptr<Node> node)
 {
-	TypeId tid = TypeId::LookupByName("ns3::UdpSocketFactory");
-	Ptr<Socket> sink = Socket::CreateSocket(node, tid);
+	Ptr<Socket> sink = Socket::CreateSocket(node, UdpSocketFactory::GetTypeId());
 	InetSocketAddress local = InetSocketAddress(addr, port);
 	sink->Bind(local);
 	sink->SetRecvCallback(MakeCallback(&RoutingExperiment::ReceivePacket, this));
@@ -145,36 +3173,384 @@ Ptr<Socket> RoutingExperiment::SetupPacketReceive(Ipv4Address addr, Ptr<Node> no
 	return sink;
 }
 
+//Queue depth of every device (MAC queue plus queue disc) and the run totals, for the live statistics reader
+void RoutingExperiment::PublishLiveStats()
+{
+	for(uint32_t i = 0; i < m_macQueues.size(); i++)
+	{
+		uint32_t packets = m_macQueues[i]->GetNPackets();
+		if(i < m_qdiscs.GetN())
+		{
+			packets += m_qdiscs.Get(i)->GetNPackets();
+		}
+		m_liveStats.SetQueueDepth(i, packets);
+	}
+	m_liveStats.Publish(totalControlPackets, totalControlBytes);
+	Simulator::Schedule(Seconds(m_liveStatsInterval), &RoutingExperiment::PublishLiveStats, this);
+}
+
+//Count every routing protocol transmission, recognised by the well known UDP ports of AODV, OLSR and DSDV and the cluster beacon port.
+//Application traffic (data, telemetry batches, offload chunks and results) is never counted, whatever port it uses.
+//Forwarded packets are counted at every hop. DSR is not counted because it carries the data inside its own headers.
+//Datagrams larger than the MTU (HELLOs and advertisements of dense clusters) are traced once per fragment and only the first fragment
+//holds the UDP header, so a control datagram counts as one packet and the later fragments are matched to it by their IP identification
+void RoutingExperiment::CountControlPacket(Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+	Ptr<Packet> copy = packet->Copy();
+	Ipv4Header ipHeader;
+	copy->RemoveHeader(ipHeader);
+	if(ipHeader.GetProtocol() != UdpL4Protocol::PROT_NUMBER)
+	{
+		return;
+	}
+
+	std::pair<uint32_t, uint64_t> datagram(ipv4->GetObject<Node>()->GetId(), (uint64_t(ipHeader.GetSource().Get()) << 16) | ipHeader.GetIdentification());
+	if(ipHeader.GetFragmentOffset() != 0)
+	{
+		std::set<std::pair<uint32_t, uint64_t> >::iterator fragment = m_controlFragments.find(datagram);
+		if(fragment == m_controlFragments.end())
+		{
+			return;
+		}
+		if(ipHeader.IsLastFragment())
+		{
+			m_controlFragments.erase(fragment);
+		}
+		controlBytes += packet->GetSize();
+		totalControlBytes += packet->GetSize();
+		return;
+	}
+
+	UdpHeader udpHeader;
+	copy->PeekHeader(udpHeader);
+	uint16_t controlPort = udpHeader.GetDestinationPort();
+	if(controlPort != ROUTING_PORT_AODV && controlPort != ROUTING_PORT_OLSR && controlPort != ROUTING_PORT_DSDV && controlPort != CLUSTER_PORT)
+	{
+		return;
+	}
+
+	if(!ipHeader.IsLastFragment())
+	{
+		m_controlFragments.insert(datagram);
+	}
+	controlPackets += 1;
+	controlBytes += packet->GetSize();
+	totalControlPackets += 1;
+	totalControlBytes += packet->GetSize();
+}
+
+//DSR has no separate control packets to count
+bool RoutingExperiment::ControlCounted() const
+{
+	return m_protocol != 4;
+}
+
+//Sojourn time of every packet leaving a root queue disc
+void RoutingExperiment::QueueSojourn(Time sojourn)
+{
+	dequeuedPackets += 1;
+	sojournTotal += sojourn;
+	sojournMax = std::max(sojournMax, sojourn);
+}
+
+//Latency and outcome of every finished pipeline frame, late offloads are reported when their result arrives. Lost offloads never get here
+void RoutingExperiment::FrameDone(Time latency, bool offloaded, bool deadlineMet)
+{
+	framesDone += 1;
+	framesHit += deadlineMet;
+	framesOffloaded += offloaded;
+	frameLatencySum += latency;
+}
+
+//The only place the protocol number becomes a type
+template <class Mobility>
+Ipv4InterfaceContainer RoutingExperiment::SelectProtocol(NodeContainer nodes, NetDeviceContainer devices, const Mobility &mobility, Ptr<PositionAllocator> positions)
+{
+	switch(m_protocol)
+	{
+		case 1:
+			return BuildScenario<OlsrProtocol>(nodes, devices, mobility, positions);
+		case 2:
+			return BuildScenario<AodvProtocol>(nodes, devices, mobility, positions);
+		case 3:
+			return BuildScenario<DsdvProtocol>(nodes, devices, mobility, positions);
+		case 4:
+			return BuildScenario<DsrProtocol>(nodes, devices, mobility, positions);
+		case 5:
+			return BuildScenario<ClusterProtocol>(nodes, devices, mobility, positions);
+		default:
+			NS_FATAL_ERROR("No such protocol:" << m_protocol);
+	}
+	return Ipv4InterfaceContainer();
+}
+
+//Mobility, routing, queue discs and addresses of the nodes. Streams are assigned in the same order as MobilityHelper, so a seed gives the same tracks
+template <class Protocol, class Mobility>
+Ipv4InterfaceContainer RoutingExperiment::BuildScenario(NodeContainer nodes, NetDeviceContainer devices, const Mobility &mobility, Ptr<PositionAllocator> positions)
+{
+	int64_t streamIndex = 0; // used to get consistent mobility across scenarios
+	streamIndex += positions->AssignStreams(streamIndex);
+	mobility.Prepare();
+	for(uint32_t i = 0; i < nodes.GetN(); i++)
+	{
+		Ptr<typename Mobility::Model> model = CreateObject<typename Mobility::Model>();
+		mobility.Configure(model);
+		nodes.Get(i)->AggregateObject(model);
+		model->SetPosition(positions->GetNextPosition());
+	}
+	for(uint32_t i = 0; i < nodes.GetN(); i++)
+	{
+		streamIndex += nodes.Get(i)->GetObject<MobilityModel>()->AssignStreams(streamIndex);
+	}
+
+	Protocol::Install(nodes, m_cluster);
+	m_protocolName = Protocol::Name();
+
+	InstallQueueDiscs(devices);
+
+	NS_LOG_INFO("assigning ip address");
+
+	Ipv4AddressHelper addressAdhoc;
+	addressAdhoc.SetBase("10.1.0.0", "255.255.0.0", "0.0.1.1"); //IP adress range and subnet mask. Starts at 10.1.1.1 and leaves room for more than 254 nodes
+	Ipv4InterfaceContainer interfaces = addressAdhoc.Assign(devices);
+
+	Protocol::Start(nodes, interfaces, m_cluster, m_clusterPeriod, m_clusterMetric);
+	return interfaces;
+}
+
+//Must run before the addresses are assigned, otherwise Ipv4AddressHelper installs pfifo_fast on the devices first.
+//The wifi MAC queue is shrunk so the standing queue builds up in the queue disc, where the AQM can act on it.
+void RoutingExperiment::InstallQueueDiscs(NetDeviceContainer devices)
+{
+	TrafficControlHelper tch;
+
+	switch(m_queueDisc)
+	{
+		case 0:
+			return;
+		case 1:
+			tch.SetRootQueueDisc("ns3::CoDelQueueDisc");
+			break;
+		case 2:
+			tch.SetRootQueueDisc("ns3::FqCoDelQueueDisc");
+			break;
+		case 3:
+		{
+			//Telemetry is marked EF, which Socket::IpTos2Priority maps to priority 4 (interactive bulk), and goes to band 0. Everything else,
+			//including the unmarked data and routing traffic (priority 0), goes to band 1
+			uint16_t handle = tch.SetRootQueueDisc("ns3::PrioQueueDisc", "Priomap", StringValue("1 1 1 1 0 1 1 1 1 1 1 1 1 1 1 1"));
+			TrafficControlHelper::ClassIdList cid = tch.AddQueueDiscClasses(handle, 2, "ns3::QueueDiscClass");
+			tch.AddChildQueueDisc(handle, cid[0], "ns3::CoDelQueueDisc");
+			tch.AddChildQueueDisc(handle, cid[1], "ns3::FqCoDelQueueDisc");
+			break;
+		}
+		default:
+			NS_FATAL_ERROR("No such queue disc:" << m_queueDisc);
+	}
+
+	tch.Install(devices);
+}
+
+//Print the delivery ratio of the data flows and the routing overhead of the whole run
+double RoutingExperiment::PrintSummary(std::ostream &os, Ptr<FlowMonitor> flowmon, FlowMonitorHelper &flowmonHelper)
+{
+	Ptr<Ipv4FlowClassifier> classifier = DynamicCast<Ipv4FlowClassifier>(flowmonHelper.GetClassifier());
+	std::map<FlowId, FlowMonitor::FlowStats> stats = flowmon->GetFlowStats();
+	uint64_t txPackets = 0;
+	uint64_t rxPackets = 0;
+
+	for(std::map<FlowId, FlowMonitor::FlowStats>::const_iterator it = stats.begin(); it != stats.end(); ++it)
+	{
+		if(classifier->FindFlow(it->first).destinationPort == port) //Data flows only, AODV/OLSR unicast replies are flows too
+		{
+			txPackets += it->second.txPackets;
+			rxPackets += it->second.rxPackets;
+		}
+	}
+
+	os << "---\n" << "Routing Protocol: " << m_protocolName << "\nNumber of Nodes: " << m_nWifis;
+	if(m_protocol == 5)
+	{
+		os << "\nNumber of Clusters: " << m_cluster.GetNClusters();
+	}
+	if(m_aggregation)
+	{
+		os << "\nTelemetry Records Received: " << totalRecordsReceived;
+	}
+	if(m_offloadPolicy != 0)
+	{
+		//Frames still in a queue when the run ends never met their deadline either. Lost frames count as misses and stay out of the latency
+		uint64_t generated = 0;
+		uint64_t lost = 0;
+		for(uint32_t i = 0; i < m_offloadClients.size(); i++)
+		{
+			generated += m_offloadClients[i]->GetFramesGenerated();
+			lost += m_offloadClients[i]->GetFramesLost();
+		}
+		os << "\nFrames Generated: " << generated << "\nDeadline Hit Rate: " << (generated ? 100.0 * totalFramesHit / generated : 0.0) << " %" << "\nFrames Offloaded: " << totalFramesOffloaded << "\nFrames Lost: " << lost << "\nAverage Frame Latency: " << (totalFramesDone ? totalFrameLatency.GetSeconds() * 1000 / totalFramesDone : 0.0) << " ms";
+	}
+	double simTime = Simulator::Now().GetSeconds();
+	os << "\nPackets Created Per Second: " << (simTime > 0 ? totalPacketsCreated / simTime : 0.0);
+	os << "\nBytes Allocated Per Second: " << (simTime > 0 ? (lastAllocatedBytes - firstAllocatedBytes) / simTime : 0.0) << " bytes" << "\nHeap Growth Per Second: " << (simTime > 0 ? (double(lastHeapBytes) - double(firstHeapBytes)) / simTime : 0.0) << " bytes";
+	double pdr = txPackets ? 100.0 * rxPackets / txPackets : 0.0;
+	os << "\nPacket Delivery Ratio: " << pdr << " %";
+	if(ControlCounted())
+	{
+		os << "\nControl Packets: " << totalControlPackets << "\nControl Bytes: " << totalControlBytes << "\n---\n";
+	}
+	else
+	{
+		os << "\nControl Packets: n/a\nControl Bytes: n/a\n---\n";
+	}
+	return pdr;
+}
+
 //CMD arguments
 std::string RoutingExperiment::CommandSetup(int argc, char **argv)
 {
 	CommandLine cmd(__FILE__);
 	cmd.AddValue("CSVfileName", "The name of the CSV output file name", m_CSVfileName);
 	cmd.AddValue("traceMobility", "Enable mobility tracing", m_traceMobility);
-	cmd.AddValue("protocol", "1=OLSR;2=AODV;3=DSDV;4=DSR", m_protocol);
+	cmd.AddValue("protocol", "1=OLSR;2=AODV;3=DSDV;4=DSR;5=Cluster", m_protocol);
+	cmd.AddValue("nWifis", "Number of nodes in the simulation", m_nWifis);
+	cmd.AddValue("tracePackets", "Enable packet metadata for tracing (costs memory on every packet)", m_tracePackets);
+	cmd.AddValue("clusterMetric", "Cluster head election: 1=Connectivity;2=Stability", m_clusterMetric);
+	cmd.AddValue("clusterPeriod", "Cluster beacon and election period (seconds)", m_clusterPeriod);
+	cmd.AddValue("queueDisc", "0=Default(pfifo_fast);1=CoDel;2=FqCoDel;3=Prio(telemetry over bulk)", m_queueDisc);
+	cmd.AddValue("telemetrySinks", "Number of sink pairs marked as telemetry traffic", m_telemetrySinks);
+	cmd.AddValue("macQueueSize", "Wifi MAC queue size when a queue disc is selected", m_macQueueSize);
+	cmd.AddValue("aggregation", "Replace the OnOff sources with telemetry aggregation", m_aggregation);
+	cmd.AddValue("aggregationWindow", "Time a telemetry batch collects records (seconds)", m_aggregationWindow);
+	cmd.AddValue("recordSize", "Telemetry record size (bytes)", m_recordSize);
+	cmd.AddValue("recordRate", "Telemetry records sampled per second by each UAV", m_recordRate);
+	cmd.AddValue("offloadPolicy", "Edge offload pipeline: 0=Off;1=Local;2=Ground;3=Adaptive", m_offloadPolicy);
+	cmd.AddValue("frameSize", "Sensor frame size (bytes)", m_frameSize);
+	cmd.AddValue("frameRate", "Sensor frames per second of each offloading UAV", m_frameRate);
+	cmd.AddValue("frameDeadline", "Time a frame has to be processed (seconds)", m_frameDeadline);
+	cmd.AddValue("uavProcessingRate", "UAV CPU speed (bytes/s)", m_uavProcessingRate);
+	cmd.AddValue("groundProcessingRate", "Ground station CPU speed (bytes/s)", m_groundProcessingRate);
+	cmd.AddValue("sitl", "Drive the nodes from ArduPilot SITL MAVLink streams in real time", m_sitl);
+	cmd.AddValue("sitlInstances", "Number of nodes driven by SITL, starting from node 0", m_sitlInstances);
+	cmd.AddValue("sitlBasePort", "MAVLink UDP port of node 0", m_sitlBasePort);
+	cmd.AddValue("sitlPortStride", "MAVLink UDP port step between nodes", m_sitlPortStride);
+	cmd.AddValue("sitlPoll", "MAVLink poll interval (seconds)", m_sitlPoll);
+	cmd.AddValue("sitlJitter", "Allowed lateness behind the wall clock (seconds)", m_sitlJitter);
+	cmd.AddValue("sitlHardLimit", "Abort the run when the lateness exceeds sitlJitter", m_sitlHardLimit);
+	cmd.AddValue("resultsDb", "SQLite file the run is added to (empty to disable)", m_resultsDb);
+	cmd.AddValue("runCache", "Run cache directory, finished configurations are served from it (empty to disable)", m_runCache);
+	cmd.AddValue("rerun", "Simulate and refresh the run cache even if it has this configuration", m_rerun);
+	cmd.AddValue("liveStats", "Memory-mapped file the live counters are published in, e.g. /dev/shm/fanet.stats (empty to disable)", m_liveStatsFile);
+	cmd.AddValue("liveStatsInterval", "Live statistics publish interval (simulated seconds)", m_liveStatsInterval);
+	cmd.AddValue("connectivity", "Write neighbour degree, link duration, partition and hop count statistics of the run", m_connectivity);
+	cmd.AddValue("connectivityInterval", "Topology sample interval (seconds)", m_connectivityInterval);
+	cmd.AddValue("analyzeMob", "Write the topology statistics of an existing .mob trace and exit without simulating", m_analyzeMob);
 	cmd.Parse(argc, argv);
 	return m_CSVfileName;
 }
 
 void RoutingExperiment::Run(int nSinks, double txp, std::string CSVfileName)
 {
-	Packet::EnablePrinting();
+	SystemWallClockMs setupClock;
+	setupClock.Start();
+	if(m_sitl) //Has to be set before anything touches the simulator
+	{
+		GlobalValue::Bind("SimulatorImplementationType", StringValue("ns3::RealtimeSimulatorImpl"));
+		if(m_sitlHardLimit)
+		{
+			Config::SetDefault("ns3::RealtimeSimulatorImpl::SynchronizationMode", EnumValue(RealtimeSimulatorImpl::SYNC_HARD_LIMIT));
+			Config::SetDefault("ns3::RealtimeSimulatorImpl::HardLimit", TimeValue(Seconds(m_sitlJitter)));
+		}
+	}
+
+	if(m_tracePackets)
+	{
+		Packet::EnablePrinting();
+	}
 	m_nSinks = nSinks;
 	m_txp = txp;
 	m_CSVfileName = CSVfileName;
 
-	int nWifis = 10; //Number of nodes in the simulation                 <<<--- MODIFY THIS
+	int nWifis = m_nWifis; //Number of nodes in the simulation, set with --nWifis
+	NS_ABORT_MSG_IF(2 * nSinks > nWifis, "Every sink needs its own source node, use at least " << 2 * nSinks << " nodes");
 
 	double TotalTime = 60.0; //Total simulation time (sec)               <<<--- MODIFY THIS
-	std::string rate("1000000bps"); //Data rate of wireless link (bps)   <<<--- MODIFY THIS
+	DataRate rate(1000000); //Data rate of wireless link (bps)            <<<--- MODIFY THIS
 	std::string phyMode("DsssRate11Mbps");
 	std::string tr_name("routingProtocolsFANET");
 	int nodeSpeed = 10; //Speed of a node's movement (m/s)               <<<--- MODIFY THIS
 	int nodePause = 1; //Time a node can stay stationary (sec)           <<<--- MODIFY THIS
+	uint32_t packetSize = 1000; //Packet size (bytes)                    <<<--- MODIFY THIS
+	Box area(0, 2000, 0, 2000, 0, 150); //Grid limits where the nodes start (m)   <<<--- MODIFY THIS
+	GaussMarkovParameters gaussMarkov; //Gauss Markov parameters         <<<--- MODIFY THIS
+	gaussMarkov.bounds = Box(0, 2000, 0, 2000, 0, 100);
+	gaussMarkov.timeStep = 0.5;
+	gaussMarkov.alpha = 0.85;
+	gaussMarkov.meanVelocityMin = 800;
+	gaussMarkov.meanVelocityMax = 1200;
+	gaussMarkov.meanDirectionMin = 0;
+	gaussMarkov.meanDirectionMax = 6.283185307;
+	gaussMarkov.meanPitchMin = 0.05;
+	gaussMarkov.meanPitchMax = 0.05;
+	gaussMarkov.normalVelocityVariance = 0.0;
+	gaussMarkov.normalVelocityBound = 0.0;
+	gaussMarkov.normalDirectionVariance = 0.2;
+	gaussMarkov.normalDirectionBound = 0.4;
+	gaussMarkov.normalPitchVariance = 0.02;
+	gaussMarkov.normalPitchBound = 0.04;
+	GaussMarkovMobility gaussMarkovMobility(gaussMarkov);
 	m_protocolName = "protocol";
 
-	Config::SetDefault("ns3::OnOffApplication::PacketSize", StringValue("1000")); //Packet size   <<<--- MODIFY THIS
-	Config::SetDefault("ns3::OnOffApplication::DataRate",  StringValue(rate));
+	m_outputFiles.clear();
+	m_outputFiles.push_back(std::make_pair("results.csv", m_CSVfileName));
+	m_outputFiles.push_back(std::make_pair("flowmon.xml", tr_name + ".flowmon"));
+	m_outputFiles.push_back(std::make_pair("mobility.mob", tr_name + ".mob"));
+	m_outputFiles.push_back(std::make_pair("animation.xml", "routingProtocolsFANET.xml"));
+	if(m_connectivity)
+	{
+		m_outputFiles.push_back(std::make_pair("connectivity.csv", tr_name + ".connectivity.csv"));
+	}
+	//SITL runs follow the wall clock and are never repeatable, so they are not cached. A cached run records its database rows in a file of
+	//its own, stored with the entry, so a cache hit can still add the run to --resultsDb
+	bool caching = !m_runCache.empty() && !m_sitl;
+	std::string runDb = tr_name + ".results.db";
+	if(caching)
+	{
+		m_outputFiles.push_back(std::make_pair("results.db", runDb));
+	}
+
+	std::ostringstream config; //Everything that changes the results of a run, defaults included
+	config << "experiment=" << tr_name << "\nversion=" << VERSION << "\nseed=" << RngSeedManager::GetSeed() << "\nrun=" << RngSeedManager::GetRun();
+	config << "\nprotocol=" << m_protocol << "\nnWifis=" << nWifis << "\nnSinks=" << nSinks << "\ntxp=" << txp << "\ntotalTime=" << TotalTime << "\nrate=" << rate << "\nphyMode=" << phyMode << "\npacketSize=" << packetSize << "\nnodeSpeed=" << nodeSpeed << "\nnodePause=" << nodePause;
+	config << "\narea=" << area.xMin << "," << area.xMax << "," << area.yMin << "," << area.yMax << "," << area.zMin << "," << area.zMax << "\n";
+	gaussMarkovMobility.Print(config);
+	config << "\nclusterMetric=" << m_clusterMetric << "\nclusterPeriod=" << m_clusterPeriod << "\nqueueDisc=" << m_queueDisc << "\ntelemetrySinks=" << m_telemetrySinks << "\nmacQueueSize=" << m_macQueueSize;
+	config << "\naggregation=" << m_aggregation << "\naggregationWindow=" << m_aggregationWindow << "\nrecordSize=" << m_recordSize << "\nrecordRate=" << m_recordRate;
+	config << "\noffloadPolicy=" << m_offloadPolicy << "\nframeSize=" << m_frameSize << "\nframeRate=" << m_frameRate << "\nframeDeadline=" << m_frameDeadline;
+	config << "\nuavProcessingRate=" << m_uavProcessingRate << "\ngroundProcessingRate=" << m_groundProcessingRate;
+	config << "\nconnectivity=" << m_connectivity << "\nconnectivityInterval=" << m_connectivityInterval << "\n";
+	m_config = config.str();
+
+	if(caching)
+	{
+		m_cache.SetDirectory(m_runCache);
+		if(m_cache.Lookup(m_config) && !m_rerun && m_cache.Restore(m_outputFiles))
+		{
+			m_cacheHit = true;
+			std::cout << "Run cache hit " << m_cache.GetKey() << ", outputs restored without simulating\n" << m_cache.GetSummary();
+			if(!m_resultsDb.empty())
+			{
+				m_results.Open(m_resultsDb);
+				m_results.Import(runDb, false);
+				m_results.Close();
+			}
+			return;
+		}
+	}
+
+	if(m_queueDisc != 0)
+	{
+		Config::SetDefault("ns3::WifiMacQueue::MaxSize", QueueSizeValue(QueueSize(m_macQueueSize)));
+	}
 
 	//Set Non-unicastMode rate to unicast mode
 	Config::SetDefault("ns3::WifiRemoteStationManager::NonUnicastMode", StringValue(phyMode));
@@ -202,110 +3578,111 @@ void RoutingExperiment::Run(int nSinks, double txp, std::string CSVfileName)
 	wifiMac.SetType("ns3::AdhocWifiMac");
 	NetDeviceContainer adhocDevices = wifi.Install(wifiPhy, wifiMac, adhocNodes);
 
-	MobilityHelper mobilityAdhoc;
-	int64_t streamIndex = 0; // used to get consistent mobility across scenarios
-
-	ObjectFactory pos;
-	pos.SetTypeId("ns3::RandomBoxPositionAllocator");
-	pos.Set("X", StringValue("ns3::UniformRandomVariable[Min=0.0|Max=2000.0]")); //Grid limit on X axis   <<<--- MODIFY THIS
-	pos.Set("Y", StringValue("ns3::UniformRandomVariable[Min=0.0|Max=2000.0]")); //Grid limit on Y axis   <<<--- MODIFY THIS
-	pos.Set("Z", StringValue("ns3::UniformRandomVariable[Min=0.0|Max=150.0]")); //Grid limit on Z axis    <<<--- MODIFY THIS
-
-	Ptr<PositionAllocator> taPositionAlloc = pos.Create()->GetObject<PositionAllocator>();
-	streamIndex += taPositionAlloc->AssignStreams(streamIndex);
-
-	std::stringstream ssSpeed;
-	ssSpeed << "ns3::UniformRandomVariable[Min=0.0|Max=" << nodeSpeed << "]";
-	std::stringstream ssPause;
-	ssPause << "ns3::ConstantRandomVariable[Constant=" << nodePause << "]";
-
-	mobilityAdhoc.SetMobilityModel("ns3::GaussMarkovMobilityModel", "Bounds", BoxValue(Box (0, 2000, 0, 2000, 0, 100)), "TimeStep", TimeValue(Seconds(0.5)), "Alpha", DoubleValue(0.85), "MeanVelocity", StringValue("ns3::UniformRandomVariable[Min=800|Max=1200]"), "MeanDirection", StringValue("ns3::UniformRandomVariable[Min=0|Max=6.283185307]"), "MeanPitch", StringValue("ns3::UniformRandomVariable[Min=0.05|Max=0.05]"), "NormalVelocity", StringValue("ns3::NormalRandomVariable[Mean=0.0|Variance=0.0|Bound=0.0]"), "NormalDirection", StringValue("ns3::NormalRandomVariable[Mean=0.0|Variance=0.2|Bound=0.4]"), "NormalPitch", StringValue("ns3::NormalRandomVariable[Mean=0.0|Variance=0.02|Bound=0.04]"));
-
-	mobilityAdhoc.SetPositionAllocator(taPositionAlloc);
-	mobilityAdhoc.Install(adhocNodes);
-	streamIndex += mobilityAdhoc.AssignStreams(adhocNodes, streamIndex);
-	NS_UNUSED(streamIndex); //From this point, streamIndex is unused
-
-	AodvHelper aodv;
-	OlsrHelper olsr;
-	DsdvHelper dsdv;
-	DsrHelper dsr;
-	DsrMainHelper dsrMain;
-	Ipv4ListRoutingHelper list;
-	InternetStackHelper internet;
-
-	switch(m_protocol)
-	{
-		case 1:
-			list.Add(olsr, 100);
-			m_protocolName = "OLSR";
-			break;
-		case 2:
-			list.Add(aodv, 100);
-			m_protocolName = "AODV";
-			break;
-		case 3:
-			list.Add(dsdv, 100);
-			m_protocolName = "DSDV";
-			break;
-		case 4:
-			m_protocolName = "DSR";
-			break;
-		default:
-			NS_FATAL_ERROR("No such protocol:" << m_protocol);
-	}
+	Ptr<RandomBoxPositionAllocator> positions = CreateObject<RandomBoxPositionAllocator>();
+	positions->SetX(UniformVariable(area.xMin, area.xMax));
+	positions->SetY(UniformVariable(area.yMin, area.yMax));
+	positions->SetZ(UniformVariable(area.zMin, area.zMax));
 
-	if(m_protocol < 4)
+	Ipv4InterfaceContainer adhocInterfaces;
+	if(m_sitl)
 	{
-		internet.SetRoutingHelper(list);
-		internet.Install(adhocNodes);
+		adhocInterfaces = SelectProtocol(adhocNodes, adhocDevices, ConstantVelocityMobility(), positions);
+		m_mavlink.Install(adhocNodes, m_sitlInstances, m_sitlBasePort, m_sitlPortStride);
+		m_mavlink.Start(m_sitlPoll, m_sitlJitter);
 	}
-	else if(m_protocol == 4)
+	else
 	{
-		internet.Install(adhocNodes);
-		dsrMain.Install(dsr, adhocNodes);
+		adhocInterfaces = SelectProtocol(adhocNodes, adhocDevices, gaussMarkovMobility, positions);
 	}
 
-	NS_LOG_INFO("assigning ip address");
+	Config::ConnectWithoutContext("/NodeList/*/$ns3::Ipv4L3Protocol/Tx", MakeCallback(&RoutingExperiment::CountControlPacket, this));
 
-	Ipv4AddressHelper addressAdhoc;
-	addressAdhoc.SetBase("10.1.1.0", "255.255.255.0"); //IP adress range and subnet mask
-	Ipv4InterfaceContainer adhocInterfaces;
-	adhocInterfaces = addressAdhoc.Assign(adhocDevices);
+	for(uint32_t i = 0; i < adhocDevices.GetN(); i++)
+	{
+		Ptr<NetDevice> device = adhocDevices.Get(i);
+		PointerValue txop;
+		DynamicCast<WifiNetDevice>(device)->GetMac()->GetAttribute("Txop", txop);
+		m_macQueues.push_back(txop.Get<Txop>()->GetWifiMacQueue());
+
+		Ptr<QueueDisc> qdisc = device->GetNode()->GetObject<TrafficControlLayer>()->GetRootQueueDiscOnDevice(device);
+		if(qdisc)
+		{
+			qdisc->TraceConnectWithoutContext("SojournTime", MakeCallback(&RoutingExperiment::QueueSojourn, this));
+			m_qdiscs.Add(qdisc);
+		}
+	}
 
-	OnOffHelper onoff1("ns3::UdpSocketFactory",Address());
-	onoff1.SetAttribute("OnTime", StringValue("ns3::ConstantRandomVariable[Constant=1.0]"));
-	onoff1.SetAttribute("OffTime", StringValue("ns3::ConstantRandomVariable[Constant=0.0]"));
+	//Always on sources. OnTime and OffTime default to type name strings that would be parsed for every source, one shared pair replaces them
+	Ptr<ConstantRandomVariable> onTime = CreateObject<ConstantRandomVariable>();
+	onTime->SetAttribute("Constant", DoubleValue(1.0));
+	Ptr<ConstantRandomVariable> offTime = CreateObject<ConstantRandomVariable>();
+	offTime->SetAttribute("Constant", DoubleValue(0.0));
+	Config::SetDefault("ns3::OnOffApplication::OnTime", PointerValue(onTime));
+	Config::SetDefault("ns3::OnOffApplication::OffTime", PointerValue(offTime));
 
 	for(int i = 0; i < nSinks; i++)
 	{
 		Ptr<Socket> sink = SetupPacketReceive(adhocInterfaces.GetAddress(i), adhocNodes.Get(i));
 
-		AddressValue remoteAddress(InetSocketAddress(adhocInterfaces.GetAddress(i), port));
-		onoff1.SetAttribute("Remote", remoteAddress);
-
-		Ptr<UniformRandomVariable> var = CreateObject<UniformRandomVariable>();
-		ApplicationContainer temp = onoff1.Install(adhocNodes.Get(i + nSinks));
-		//temp.Start(Seconds(var->GetValue(100.0,101.0))); //Delay to start at 100 sec
-		temp.Start(Seconds(0.0));
-		temp.Stop(Seconds(TotalTime));
+		if(m_offloadPolicy != 0)
+		{
+			//The source node of each pair runs the pipeline against ground station i, next to the configured traffic
+			Ptr<EdgeOffloadServer> server = CreateObject<EdgeOffloadServer>();
+			server->Setup(m_frameSize, m_groundProcessingRate, m_frameDeadline);
+			adhocNodes.Get(i)->AddApplication(server);
+			server->SetStartTime(Seconds(0.0));
+			server->SetStopTime(Seconds(TotalTime));
+
+			Ptr<EdgeOffloadClient> client = CreateObject<EdgeOffloadClient>();
+			client->Setup(InetSocketAddress(adhocInterfaces.GetAddress(i), OFFLOAD_PORT), m_offloadPolicy, m_frameSize, m_frameRate, m_frameDeadline, m_uavProcessingRate);
+			client->TraceConnectWithoutContext("FrameDone", MakeCallback(&RoutingExperiment::FrameDone, this));
+			adhocNodes.Get(i + nSinks)->AddApplication(client);
+			client->SetStartTime(Seconds(0.0));
+			client->SetStopTime(Seconds(TotalTime));
+			m_offloadClients.push_back(client);
+		}
+
+		InetSocketAddress remote(adhocInterfaces.GetAddress(i), port);
+		if(i < int(m_telemetrySinks))
+		{
+			remote.SetTos(0xb8); //EF, mapped to socket priority 4 ((0xb8 & 0x1e) >> 1 = 12 -> NS3_PRIO_INTERACTIVE_BULK)
+		}
+		if(m_aggregation)
+		{
+			//Node i + nSinks collects for ground station i, every UAV that is neither a sink nor a collector sends its batches to one of the collectors
+			Ptr<TelemetryAggregator> collector = CreateObject<TelemetryAggregator>();
+			collector->Setup(remote, m_recordSize, m_recordRate, m_aggregationWindow, true);
+			adhocNodes.Get(i + nSinks)->AddApplication(collector);
+			collector->SetStartTime(Seconds(0.0));
+			collector->SetStopTime(Seconds(TotalTime));
+
+			InetSocketAddress collectorAddress(adhocInterfaces.GetAddress(i + nSinks), TELEMETRY_PORT);
+			collectorAddress.SetTos(remote.GetTos());
+			for(int j = 2 * nSinks + i; j < nWifis; j += nSinks)
+			{
+				Ptr<TelemetryAggregator> uav = CreateObject<TelemetryAggregator>();
+				uav->Setup(collectorAddress, m_recordSize, m_recordRate, m_aggregationWindow, false);
+				adhocNodes.Get(j)->AddApplication(uav);
+				uav->SetStartTime(Seconds(0.0));
+				uav->SetStopTime(Seconds(TotalTime));
+			}
+			continue;
+		}
+
+		Ptr<OnOffApplication> onoff = CreateObject<OnOffApplication>();
+		onoff->SetAttribute("Protocol", TypeIdValue(UdpSocketFactory::GetTypeId()));
+		onoff->SetAttribute("Remote", AddressValue(remote));
+		onoff->SetAttribute("PacketSize", UintegerValue(packetSize));
+		onoff->SetAttribute("DataRate", DataRateValue(rate));
+		adhocNodes.Get(i + nSinks)->AddApplication(onoff);
+		onoff->SetStartTime(Seconds(0.0));
+		onoff->SetStopTime(Seconds(TotalTime));
 	}
 
-	std::stringstream ss;
-	ss << nWifis;
-	std::string nodes = ss.str();
-
-	std::stringstream ss2;
-	ss2 << nodeSpeed;
-	std::string sNodeSpeed = ss2.str();
-
-	std::stringstream ss3;
-	ss3 << nodePause;
-	std::string sNodePause = ss3.str();
-
-	std::stringstream ss4;
-	ss4 << rate;
-	std::string sRate = ss4.str();
+	if(m_connectivity)
+	{
+		m_analyzer.Install(adhocNodes, ConnectivityAnalyzer::FriisRange(txp), m_connectivityInterval, tr_name + ".connectivity.csv");
+	}
 
 	AsciiTraceHelper ascii;
 	MobilityHelper::EnableAsciiAll(ascii.CreateFileStream(tr_name + ".mob"));
@@ -317,30 +3694,121 @@ void RoutingExperiment::Run(int nSinks, double txp, std::string CSVfileName)
 
 	NS_LOG_INFO("Run Simulation.");
 
+	if(caching)
+	{
+		remove(runDb.c_str());
+		remove((runDb + "-wal").c_str());
+		remove((runDb + "-shm").c_str());
+		m_results.Open(runDb);
+		m_results.BeginRun(tr_name, m_protocolName, nWifis, nSinks, txp, m_config);
+	}
+	else if(!m_resultsDb.empty())
+	{
+		m_results.Open(m_resultsDb);
+		m_results.BeginRun(tr_name, m_protocolName, nWifis, nSinks, txp, m_config);
+	}
+
+	if(!m_liveStatsFile.empty())
+	{
+		m_liveStats.Open(m_liveStatsFile, nSinks, m_macQueues.size(), TotalTime);
+		PublishLiveStats();
+	}
+
 	CheckThroughput();
 	std::cout << "Creating XML Animation File: " << m_CSVfileName << " ...\n";
 	AnimationInterface anim("routingProtocolsFANET.xml"); //Create XML file for NetAnim visualisation
 	Simulator::Stop(Seconds(TotalTime));
+	int64_t setupMs = setupClock.End();
+	SystemWallClockMs wallClock;
+	wallClock.Start();
 	Simulator::Run();
+	int64_t wallMs = wallClock.End();
+	if(m_liveStats.IsOpen())
+	{
+		m_liveStats.Publish(totalControlPackets, totalControlBytes);
+		m_liveStats.Finish();
+		m_liveStats.Close();
+	}
+
+	if(m_sitl)
+	{
+		m_mavlink.Close();
+		m_mavlink.PrintStats(std::cout);
+	}
 
 	flowmon->SerializeToXmlFile((tr_name + ".flowmon").c_str(), false, false); //Name of the XML file storing the Flowmonitor data
+	std::ostringstream summary;
+	double pdr = PrintSummary(summary, flowmon, flowmonHelper);
+	if(m_connectivity)
+	{
+		m_analyzer.PrintStats(summary);
+	}
+	std::cout << summary.str();
+	m_summary = summary.str();
+
+	PrintRunPerformance(setupMs, wallMs);
+
+	if(m_results.IsOpen())
+	{
+		m_results.AddFlows(flowmon, DynamicCast<Ipv4FlowClassifier>(flowmonHelper.GetClassifier()));
+		m_results.EndRun(pdr, ControlCounted(), totalControlPackets, totalControlBytes, wallMs / 1000.0);
+		m_results.Close();
+	}
+	if(caching && !m_resultsDb.empty())
+	{
+		m_results.Open(m_resultsDb);
+		m_results.Import(runDb, m_rerun);
+		m_results.Close();
+	}
 
 	Simulator::Destroy();
 }
 
+//Called once Run has returned, by then the animation and mobility trace files are closed
+void RoutingExperiment::StoreCachedRun()
+{
+	if(m_cache.IsEnabled() && !m_cacheHit)
+	{
+		m_cache.Store(m_outputFiles, m_summary);
+	}
+}
+
+//Topology statistics of the trace given with --analyzeMob, written next to it as <trace>.connectivity.csv. Returns false when there is none
+bool RoutingExperiment::AnalyzeTrace(double txp)
+{
+	if(m_analyzeMob.empty())
+	{
+		return false;
+	}
+	std::string base = m_analyzeMob;
+	if(base.size() > 4 && base.compare(base.size() - 4, 4, ".mob") == 0)
+	{
+		base.erase(base.size() - 4);
+	}
+	m_analyzer.AnalyzeTrace(m_analyzeMob, ConnectivityAnalyzer::FriisRange(txp), m_connectivityInterval, base + ".connectivity.csv");
+	m_analyzer.PrintStats(std::cout);
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 int main (int argc, char *argv[])
 {
 	RoutingExperiment experiment;
 	std::string CSVfileName = experiment.CommandSetup(argc,argv);
 
+	int nSinks = 2; //Number of receivers       <<<--- MODIFY THIS
+	double txp = 27.0; //Transmitt power (dBm)   <<<--- MODIFY THIS
+
+	if(experiment.AnalyzeTrace(txp))
+	{
+		return 0;
+	}
+
 	//blank out the last output file and write the column headers
 	std::ofstream out(CSVfileName.c_str());
-	out << "SimulationSecond," << "ReceiveRate," << "PacketsReceived," << "NumberOfSinks," << "RoutingProtocol," <<	"TransmissionPower" << std::endl;
+	out << "SimulationSecond," << "ReceiveRate," << "PacketsReceived," << "NumberOfSinks," << "RoutingProtocol," <<	"TransmissionPower," << "NumberOfNodes," << "ControlPackets," << "ControlBytes," << "QueuePackets," << "AvgSojournMs," << "MaxSojournMs," << "QueueDrops," << "RecordsReceived," << "AvgRecordDelayMs," << "FramesDone," << "FramesHit," << "FramesOffloaded," << "AvgFrameLatencyMs," << "PacketsCreated," << "QueuedPackets," << "HeapBytes," << "AllocatedBytes" << std::endl;
 	out.close();
 
-	int nSinks = 2; //Number of receivers       <<<--- MODIFY THIS
-	double txp = 27.0; //Transmitt power (dBm)   <<<--- MODIFY THIS
-
 	experiment.Run(nSinks, txp, CSVfileName);
+	experiment.StoreCachedRun();
 }
\ No newline at end of file
@@ -28,6 +28,9 @@
 #include <fstream>
 #include <iostream>
 
+//POSIX Libraries
+#include <sys/resource.h>
+
 //NS3 Libraries
 #include "ns3/core-module.h"
 #include "ns3/network-module.h"
@@ -72,8 +75,21 @@ class RoutingExperiment
 		double m_txp; //Transmit power (dBm)
 		bool m_traceMobility; //Enable-Disable mobility tracing
 		uint32_t m_protocol; //Routing protocol selector (number)
+		bool m_tracePackets; //Enable packet metadata (printing) for tracing
+		uint32_t m_nWifis; //Number of nodes in the simulation
 };
 
+//Wall time, simulator event rate and peak memory of the run, parsed by Scripts/benchmark.sh. Setup Time covers Run() up to the
+//simulation (scenario, stack, applications and traces), Wall Time and Events Per Second cover Simulator::Run only
+static void PrintRunPerformance(int64_t setupMs, int64_t wallMs)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	uint64_t events = Simulator::GetEventCount();
+
+	std::cout << "---\n" << "Setup Time: " << setupMs / 1000.0 << " s" << "\nWall Time: " << wallMs / 1000.0 << " s" << "\nSimulator Events: " << events << "\nEvents Per Second: " << (wallMs > 0 ? events * 1000.0 / wallMs : 0.0) << "\nPeak RSS: " << usage.ru_maxrss << " kB" << "\n---\n";
+}
+
 //Constuctor with default values. those can be overwritten with cmd arguments
 RoutingExperiment::RoutingExperiment()
 {
@@ -83,6 +99,8 @@ RoutingExperiment::RoutingExperiment()
 	m_CSVfileName = "routingProtocolsMANET.csv";  //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
 	m_traceMobility = false;                      //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
 	m_protocol = 2; // AODV                       //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_tracePackets = false;                       //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
+	m_nWifis = 25;                                //<<<--- MODIFY THIS OR USE CMD ARGUMENTS
 }
 
 //Print when each packet is received, on which port and from which sender
@@ -152,18 +170,26 @@ std::string RoutingExperiment::CommandSetup(int argc, char **argv)
 	cmd.AddValue("CSVfileName", "The name of the CSV output file name", m_CSVfileName);
 	cmd.AddValue("traceMobility", "Enable mobility tracing", m_traceMobility);
 	cmd.AddValue("protocol", "1=OLSR;2=AODV;3=DSDV;4=DSR", m_protocol);
+	cmd.AddValue("nWifis", "Number of nodes in the simulation", m_nWifis);
+	cmd.AddValue("tracePackets", "Enable packet metadata for tracing (costs memory on every packet)", m_tracePackets);
 	cmd.Parse(argc, argv);
 	return m_CSVfileName;
 }
 
 void RoutingExperiment::Run(int nSinks, double txp, std::string CSVfileName)
 {
-	Packet::EnablePrinting();
+	SystemWallClockMs setupClock;
+	setupClock.Start();
+	if(m_tracePackets)
+	{
+		Packet::EnablePrinting();
+	}
 	m_nSinks = nSinks;
 	m_txp = txp;
 	m_CSVfileName = CSVfileName;
 
-	int nWifis = 25; //Number of nodes in the simulation                 <<<--- MODIFY THIS
+	int nWifis = m_nWifis; //Number of nodes in the simulation, set with --nWifis
+	NS_ABORT_MSG_IF(2 * nSinks > nWifis, "Every sink needs its own source node, use at least " << 2 * nSinks << " nodes");
 
 	double TotalTime = 60.0; //Total simulation time (sec)               <<<--- MODIFY THIS
 	std::string rate("1000000bps"); //Data rate of wireless link (bps)   <<<--- MODIFY THIS
@@ -320,10 +346,16 @@ void RoutingExperiment::Run(int nSinks, double txp, std::string CSVfileName)
 	std::cout << "Creating XML Animation File: " << m_CSVfileName << " ...\n";
 	AnimationInterface anim("routingProtocolsMANET.xml"); //Create XML file for NetAnim visualisation
 	Simulator::Stop(Seconds(TotalTime));
+	int64_t setupMs = setupClock.End();
+	SystemWallClockMs wallClock;
+	wallClock.Start();
 	Simulator::Run();
+	int64_t wallMs = wallClock.End();
 
 	flowmon->SerializeToXmlFile((tr_name + ".flowmon").c_str(), false, false); //Name of the XML file storing the Flowmonitor data
 
+	PrintRunPerformance(setupMs, wallMs);
+
 	Simulator::Destroy();
 }
 
@@ -0,0 +1,96 @@
+# Scaling benchmark for routingProtocolsFANET and routingProtocolsMANET
+# Runs every nodes x protocol configuration with fixed seeds and writes one CSV row per run:
+# binary,protocol,nodes,seed,setup_s,wall_s,events,events_per_s,peak_rss_kb,output_bytes
+# setup_s is the scenario construction before the simulation starts, wall_s and events_per_s cover the simulation only.
+# When a baseline CSV is given, every run is compared with it and the script exits with 1 if setup plus wall time or peak RSS grew by more
+# than THRESHOLD %. Columns are matched by the header, so a baseline without setup_s is compared on wall time alone.
+# A run that exits with an error or prints no performance block is written with FAILED in every metric column. Any FAILED run, or with a
+# baseline any run the baseline has no successful row for, makes the script exit with 1.
+# Run from the ns-3 root directory with both scripts in scratch/ and already built. Usage: sh benchmark.sh [baseline.csv]
+
+BASELINE=$1
+REPORT=${REPORT:-benchmark.csv}
+THRESHOLD=${THRESHOLD:-10}
+SEED=1
+RUN=1
+NODES="10 25 50 100 200"
+PROTOCOLS="1:OLSR 2:AODV 4:DSR"
+WORKDIR=$(mktemp -d)
+FAILURES=0
+
+echo "binary,protocol,nodes,seed,setup_s,wall_s,events,events_per_s,peak_rss_kb,output_bytes" > $REPORT
+
+for BINARY in routingProtocolsFANET routingProtocolsMANET
+do
+	for N in $NODES
+	do
+		# MANET uses 12 sinks, so it needs at least 24 nodes
+		if [ $BINARY = routingProtocolsMANET ] && [ $N -lt 24 ]
+		then
+			continue
+		fi
+		for P in $PROTOCOLS
+		do
+			ID=${P%%:*}
+			NAME=${P##*:}
+			RUNDIR=$WORKDIR/${BINARY}_${N}_${NAME}
+			mkdir -p $RUNDIR
+
+			./waf --run-no-build "scratch/$BINARY --protocol=$ID --nWifis=$N --RngSeed=$SEED --RngRun=$RUN" --cwd=$RUNDIR > $RUNDIR/stdout.txt 2>&1
+			STATUS=$?
+
+			SETUP=$(grep "^Setup Time:" $RUNDIR/stdout.txt | awk '{print $3}')
+			WALL=$(grep "^Wall Time:" $RUNDIR/stdout.txt | awk '{print $3}')
+			EVENTS=$(grep "^Simulator Events:" $RUNDIR/stdout.txt | awk '{print $3}')
+			EPS=$(grep "^Events Per Second:" $RUNDIR/stdout.txt | awk '{print $4}')
+			RSS=$(grep "^Peak RSS:" $RUNDIR/stdout.txt | awk '{print $3}')
+			BYTES=$(cat $RUNDIR/* | wc -c)
+			if [ $STATUS -ne 0 ] || [ -z "$SETUP" ] || [ -z "$WALL" ] || [ -z "$EVENTS" ] || [ -z "$EPS" ] || [ -z "$RSS" ]
+			then
+				FAILURES=$((FAILURES + 1))
+				echo "$BINARY,$NAME,$N,$SEED,FAILED,FAILED,FAILED,FAILED,FAILED,FAILED" >> $REPORT
+				echo "$BINARY $NAME $N nodes: FAILED (exit status $STATUS), output:"
+				tail -n 20 $RUNDIR/stdout.txt
+				continue
+			fi
+			echo "$BINARY,$NAME,$N,$SEED,$SETUP,$WALL,$EVENTS,$EPS,$RSS,$BYTES" >> $REPORT
+			echo "$BINARY $NAME $N nodes: ${SETUP} s setup, ${WALL} s, ${EPS} events/s, ${RSS} kB"
+		done
+	done
+done
+
+rm -rf $WORKDIR
+
+if [ -n "$BASELINE" ]
+then
+	# Join on binary,protocol,nodes and print the relative change of every metric
+	awk -F, -v threshold=$THRESHOLD '
+		function change(now, before) { return before > 0 ? 100.0 * (now - before) / before : 0 }
+		function get(name) { return (name in column) ? $column[name] : 0 }
+		function failed() { return get("wall_s") == "FAILED" || get("wall_s") == "" }
+		# Column positions come from the header of each file, setup times are compared only when both files have them
+		FNR == 1 {
+			split("", column)
+			for (i = 1; i <= NF; i++) column[$i] = i
+			if (NR == FNR) baselineSetup = ("setup_s" in column); else setupKnown = baselineSetup && ("setup_s" in column)
+			next
+		}
+		# Failed baseline runs (FAILED, or blank from older reports) are left out, so the configuration counts as missing from the baseline
+		NR == FNR && failed() { next }
+		NR == FNR { key = $1 "," $2 "," $3; setup[key] = get("setup_s"); wall[key] = get("wall_s"); eps[key] = get("events_per_s"); rss[key] = get("peak_rss_kb"); bytes[key] = get("output_bytes"); next }
+		{
+			key = $1 "," $2 "," $3
+			if (failed()) { printf "%s: FAILED\n", key; regressions++; next }
+			if (!(key in wall)) { printf "%s: not in baseline\n", key; regressions++; next }
+			s = setupKnown ? change(get("setup_s"), setup[key]) : 0
+			t = setupKnown ? change(get("setup_s") + get("wall_s"), setup[key] + wall[key]) : change(get("wall_s"), wall[key])
+			w = change(get("wall_s"), wall[key]); e = change(get("events_per_s"), eps[key]); r = change(get("peak_rss_kb"), rss[key]); b = change(get("output_bytes"), bytes[key])
+			flag = (t > threshold || r > threshold) ? "  REGRESSION" : ""
+			if (flag != "") regressions++
+			printf "%s: setup %+.1f%%, wall %+.1f%%, total %+.1f%%, events/s %+.1f%%, rss %+.1f%%, output %+.1f%%%s\n", key, s, w, t, e, r, b, flag
+		}
+		END { exit regressions > 0 }
+	' $BASELINE $REPORT || FAILURES=$((FAILURES + 1))
+fi
+
+[ $FAILURES -eq 0 ]
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+# Live statistics viewer for routingProtocolsFANET --liveStats=<file>
+# Maps the file read-only and prints the counters of the running simulation every second, until the run finishes.
+# With --max-wall-ratio R the run is killed when its wall time exceeds R times the simulated time reached (runaway configuration).
+# Usage: python3 livestats.py /dev/shm/fanet.stats [--interval 1] [--max-wall-ratio 20]
+
+import argparse
+import mmap
+import os
+import signal
+import struct
+import sys
+import time
+
+MAGIC = 0x31534c54454e4146  # "FANETLS1"
+HEADER = struct.Struct("<QIIIIII4d3Q")  # Same layout as LiveStatsHeader
+
+
+def read(region):
+    """Consistent copy of the region: retry while the writer is inside an update"""
+    while True:
+        before = struct.unpack_from("<I", region, 8)[0]
+        data = bytes(region)
+        after = struct.unpack_from("<I", region, 8)[0]
+        if before == after and before % 2 == 0:
+            return data
+        time.sleep(0.001)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("file")
+    parser.add_argument("--interval", type=float, default=1.0)
+    parser.add_argument("--max-wall-ratio", type=float, default=0.0)
+    args = parser.parse_args()
+
+    with open(args.file, "rb") as f:
+        region = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+
+    while True:
+        data = read(region)
+        (magic, sequence, pid, sinks, devices, finished, _, total_time, sim_time, wall_time, events_per_s,
+         events, control_packets, control_bytes) = HEADER.unpack_from(data)
+        if magic != MAGIC:
+            time.sleep(args.interval)
+            continue
+
+        offset = HEADER.size
+        sink_packets = struct.unpack_from("<%dQ" % sinks, data, offset)
+        sink_bytes = struct.unpack_from("<%dQ" % sinks, data, offset + 8 * sinks)
+        queue_depth = struct.unpack_from("<%dI" % devices, data, offset + 16 * sinks)
+
+        print("pid %d  sim %.1f/%.1f s  wall %.1f s  %.0f events/s  control %d pkts %d B  queued %d (max %d)" % (
+            pid, sim_time, total_time, wall_time, events_per_s, control_packets, control_bytes,
+            sum(queue_depth), max(queue_depth) if queue_depth else 0))
+        print("  sinks: " + " ".join("%d:%d/%dB" % (i, sink_packets[i], sink_bytes[i]) for i in range(sinks)))
+        sys.stdout.flush()
+
+        if finished:
+            return 0
+        if args.max_wall_ratio > 0 and sim_time > 0 and wall_time > args.max_wall_ratio * sim_time:
+            print("wall time is over %g times the simulated time, stopping pid %d" % (args.max_wall_ratio, pid))
+            os.kill(pid, signal.SIGTERM)
+            return 1
+        time.sleep(args.interval)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,12 @@
+# Starts N ArduCopter SITL instances for the SITL driven mobility of routingProtocolsFANET (--sitl --sitlInstances=N)
+# Instance i streams MAVLink to 127.0.0.1:(14550 + 10 * i), the default --sitlBasePort and --sitlPortStride
+# Run from the ardupilot directory cloned by repos.sh. Usage: sh sitl.sh <instances>
+
+INSTANCES=${1:-1}
+i=0
+while [ $i -lt $INSTANCES ]
+do
+	Tools/autotest/sim_vehicle.py -v ArduCopter -I $i --mavproxy-args="--daemon" --out=udp:127.0.0.1:$((14550 + 10 * i)) > sitl_$i.log 2>&1 &
+	i=$((i + 1))
+done
+wait
@@ -0,0 +1,35 @@
+# Parameter sweep for routingProtocolsFANET backed by the run cache
+# Every configuration is simulated once, later sweeps (e.g. after adding a node count) only simulate the new points.
+# Run from the ns-3 root directory with the script in scratch/ and already built. Usage: sh sweep.sh [cache directory]
+# Set RERUN=true to simulate every point again and refresh the cache.
+# Every point, simulated or cached, is added once to the SQLite file RESULTS (default results.db), e.g. PDR vs nodes for all protocols:
+#   sqlite3 results.db "SELECT protocol, nodes, AVG(pdr) FROM runs GROUP BY protocol, nodes"
+
+CACHE=${1:-$PWD/runcache}
+RERUN=${RERUN:-false}
+RESULTS=${RESULTS:-$PWD/results.db}
+NODES="10 20 30 50"
+PROTOCOLS="1 2 3 4"
+SEEDS="1 2 3"
+OUTDIR=sweep
+
+mkdir -p $CACHE $OUTDIR
+
+for N in $NODES
+do
+	for P in $PROTOCOLS
+	do
+		for S in $SEEDS
+		do
+			RUNDIR=$OUTDIR/n${N}_p${P}_s${S}
+			mkdir -p $RUNDIR
+			./waf --run-no-build "scratch/routingProtocolsFANET --protocol=$P --nWifis=$N --RngRun=$S --runCache=$CACHE --rerun=$RERUN --resultsDb=$RESULTS" --cwd=$RUNDIR > $RUNDIR/stdout.txt 2>&1
+			if grep -q "^Run cache hit" $RUNDIR/stdout.txt
+			then
+				echo "n=$N protocol=$P run=$S cached"
+			else
+				echo "n=$N protocol=$P run=$S simulated"
+			fi
+		done
+	done
+done